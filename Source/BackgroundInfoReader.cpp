@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+
+#include "BackgroundInfoReader.h"
+
+
+// the flattened layout of a BMessage, see headers/private/app/MessagePrivate.h
+static const uint32 kMessageFormat = 0x31464d48;		// '1FMH'
+static const uint32 kMessageFormatSwapped = 0x484d4631;	// 'HMF1'
+
+// format, what, flags, current_specifier, message_area, reply_port, reply_target,
+// reply_team, data_size, field_count, hash_table_size, hash_table[5]
+static const size_t kHeaderSize = 64;
+static const size_t kHeaderWhatOffset = 4;
+static const size_t kHeaderDataSizeOffset = 32;
+static const size_t kHeaderFieldCountOffset = 36;
+
+// flags, name_length, type, count, data_size, offset, next_field
+static const size_t kFieldHeaderSize = 24;
+static const uint16 kFieldFlagFixedSize = 0x0002;
+
+
+BackgroundInfoReader::BackgroundInfoReader() :
+	fWhat(0),
+	fSwapped(false),
+	fInitStatus(B_NO_INIT)
+{
+}
+
+
+BackgroundInfoReader::BackgroundInfoReader(const void* buffer, size_t size) :
+	BackgroundInfoReader()
+{
+	SetTo(buffer, size);
+}
+
+
+status_t
+BackgroundInfoReader::SetTo(const void* buffer, size_t size)
+{
+	Unset();
+
+	const uint8* flatBuffer = static_cast<const uint8*>(buffer);
+	if (flatBuffer == nullptr || size < kHeaderSize)
+		return fInitStatus = B_BAD_VALUE;
+
+	uint32 format;
+	memcpy(&format, flatBuffer, sizeof(format));
+	if (format == kMessageFormatSwapped)
+		fSwapped = true;
+	else if (format != kMessageFormat)
+		// R5/Dano formats are left for BMessage::Unflatten() to deal with
+		return fInitStatus = B_BAD_TYPE;
+
+	fWhat = _Read32(flatBuffer + kHeaderWhatOffset);
+	uint32 dataSize = _Read32(flatBuffer + kHeaderDataSizeOffset);
+	uint32 fieldCount = _Read32(flatBuffer + kHeaderFieldCountOffset);
+
+	// use 64bit math so a corrupt header can't overflow our size checks
+	uint64 fieldsSize = (uint64)fieldCount * kFieldHeaderSize;
+	if (kHeaderSize + fieldsSize + dataSize > size)
+		return fInitStatus = B_BAD_DATA;
+
+	const uint8* fields = flatBuffer + kHeaderSize;
+	const uint8* data = fields + fieldsSize;
+
+	for (uint32 x = 0; x < fieldCount; x++) {
+		const uint8* field = fields + x * kFieldHeaderSize;
+		uint16 flags = _Read16(field);
+		uint16 nameLength = _Read16(field + 2);
+		type_code type = _Read32(field + 4);
+		uint32 count = _Read32(field + 8);
+		uint32 fieldDataSize = _Read32(field + 12);
+		uint32 offset = _Read32(field + 16);
+
+		if (nameLength == 0 || (uint64)offset + nameLength + fieldDataSize > dataSize || count > INT32_MAX)
+			return fInitStatus = B_BAD_DATA;
+
+		const char* name = reinterpret_cast<const char*>(data + offset);
+		if (name[nameLength - 1] != '\0')
+			return fInitStatus = B_BAD_DATA;
+
+		const uint8* fieldData = data + offset + nameLength;
+
+		status_t status = B_OK;
+		if (strcmp(name, B_BACKGROUND_WORKSPACES) == 0)
+			status = _SetFixedArray(fWorkspaces, B_INT32_TYPE, flags, type, count, fieldData, fieldDataSize);
+		else if (strcmp(name, B_BACKGROUND_IMAGE) == 0)
+			status = _SetStringArray(fImages, flags, type, count, fieldData, fieldDataSize);
+		else if (strcmp(name, B_BACKGROUND_MODE) == 0)
+			status = _SetFixedArray(fModes, B_INT32_TYPE, flags, type, count, fieldData, fieldDataSize);
+		else if (strcmp(name, B_BACKGROUND_ORIGIN) == 0)
+			status = _SetFixedArray(fOrigins, B_POINT_TYPE, flags, type, count, fieldData, fieldDataSize);
+		else if (strcmp(name, B_BACKGROUND_ERASE_TEXT) == 0)
+			status = _SetFixedArray(fEraseText, B_BOOL_TYPE, flags, type, count, fieldData, fieldDataSize);
+		else if (strcmp(name, BACKGROUND_SET) == 0)
+			status = _SetFixedArray(fSetFlags, B_INT32_TYPE, flags, type, count, fieldData, fieldDataSize);
+
+		if (status != B_OK)
+			return fInitStatus = status;
+	}
+
+	return fInitStatus = B_OK;
+}
+
+
+void
+BackgroundInfoReader::Unset()
+{
+	fWorkspaces = FixedArray<int32>();
+	fImages = StringArray();
+	fModes = FixedArray<int32>();
+	fOrigins = FixedArray<background_origin>();
+	fEraseText = FixedArray<bool>();
+	fSetFlags = FixedArray<int32>();
+	fWhat = 0;
+	fSwapped = false;
+	fInitStatus = B_NO_INIT;
+}
+
+
+status_t
+BackgroundInfoReader::InitCheck() const
+{
+	return fInitStatus;
+}
+
+
+uint64
+BackgroundInfoReader::HashData(const void* data, size_t size)
+{
+	// 64bit FNV-1a, only used to notice if the flattened data changed
+	const uint8* bytes = static_cast<const uint8*>(data);
+	uint64 hash = 0xcbf29ce484222325ULL;
+	for (size_t x = 0; x < size; x++) {
+		hash ^= bytes[x];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+
+template<typename T>
+status_t
+BackgroundInfoReader::_SetFixedArray(FixedArray<T>& array, type_code wantedType, uint16 flags, type_code type,
+	int32 count, const uint8* data, uint32 dataSize)
+{
+	if (type != wantedType)
+		return B_BAD_TYPE;
+
+	if ((flags & kFieldFlagFixedSize) == 0 || (uint64)count * sizeof(T) != dataSize)
+		return B_BAD_DATA;
+
+	array.fData = data;
+	array.fCount = count;
+	array.fSwapped = fSwapped;
+
+	return B_OK;
+}
+
+
+status_t
+BackgroundInfoReader::_SetStringArray(StringArray& array, uint16 flags, type_code type, int32 count,
+	const uint8* data, uint32 dataSize)
+{
+	if (type != B_STRING_TYPE)
+		return B_BAD_TYPE;
+
+	if ((flags & kFieldFlagFixedSize) != 0)
+		return B_BAD_DATA;
+
+	// each item is stored as a uint32 size followed by the string and its terminator
+	uint64 position = 0;
+	for (int32 x = 0; x < count; x++) {
+		if (position + sizeof(uint32) > dataSize)
+			return B_BAD_DATA;
+
+		uint32 itemSize = _Read32(data + position);
+		position += sizeof(uint32);
+		if (itemSize == 0 || position + itemSize > dataSize || data[position + itemSize - 1] != '\0')
+			return B_BAD_DATA;
+
+		position += itemSize;
+	}
+
+	array.fData = data;
+	array.fSize = dataSize;
+	array.fCount = count;
+	array.fSwapped = fSwapped;
+
+	return B_OK;
+}
+
+
+std::string_view
+BackgroundInfoReader::StringArray::ItemAt(int32 index, std::string_view defaultValue) const
+{
+	if (index < 0 || index >= fCount)
+		return defaultValue;
+
+	// the items were validated in _SetStringArray(), just walk the size prefixes
+	const uint8* item = fData;
+	for (int32 x = 0;; x++) {
+		uint32 itemSize;
+		memcpy(&itemSize, item, sizeof(itemSize));
+		if (fSwapped)
+			_SwapWords(&itemSize, sizeof(itemSize));
+
+		if (x == index)
+			return std::string_view(reinterpret_cast<const char*>(item + sizeof(uint32)), itemSize - 1);
+
+		item += sizeof(uint32) + itemSize;
+	}
+}
+
+
+uint16
+BackgroundInfoReader::_Read16(const uint8* data) const
+{
+	uint16 value;
+	memcpy(&value, data, sizeof(value));
+	if (fSwapped)
+		value = (uint16)((value << 8) | (value >> 8));
+
+	return value;
+}
+
+
+uint32
+BackgroundInfoReader::_Read32(const uint8* data) const
+{
+	uint32 value;
+	memcpy(&value, data, sizeof(value));
+	if (fSwapped)
+		_SwapWords(&value, sizeof(value));
+
+	return value;
+}
+
+
+void
+BackgroundInfoReader::_SwapWords(void* data, size_t size)
+{
+	// swap each 32bit word in place, smaller items(bool) don't need swapping
+	uint8* bytes = static_cast<uint8*>(data);
+	for (size_t x = 0; x + 4 <= size; x += 4) {
+		uint8 temp = bytes[x];
+		bytes[x] = bytes[x + 3];
+		bytes[x + 3] = temp;
+		temp = bytes[x + 1];
+		bytes[x + 1] = bytes[x + 2];
+		bytes[x + 2] = temp;
+	}
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+#include "PortableDefs.h"
+
+#include <cstring>
+#include <string_view>
+
+#ifdef __HAIKU__
+#include <be_apps/Tracker/Background.h>
+#else
+#define B_BACKGROUND_INFO "be:bgndimginfo"
+#define B_BACKGROUND_IMAGE "be:bgndimginfopath"
+#define B_BACKGROUND_MODE "be:bgndimginfomode"
+#define B_BACKGROUND_ORIGIN "be:bgndimginfooffset"
+#define B_BACKGROUND_ERASE_TEXT "be:bgndimginfoerasetext"
+#define B_BACKGROUND_WORKSPACES "be:bgndimginfoworkspaces"
+
+enum {
+	B_BACKGROUND_MODE_USE_ORIGIN,
+	B_BACKGROUND_MODE_CENTERED,
+	B_BACKGROUND_MODE_SCALED,
+	B_BACKGROUND_MODE_TILED
+};
+#endif
+
+#define BACKGROUND_SET "be:bgndimginfoset"
+
+
+// same memory layout as a flattened BPoint
+struct background_origin {
+	float x;
+	float y;
+};
+
+
+// Reads the fields of a flattened B_BACKGROUND_INFO message directly from the
+// attribute data.  Nothing is copied, the arrays point into the buffer given
+// to SetTo() which must stay valid as long as the reader is used.
+class BackgroundInfoReader {
+public:
+	template<typename T>
+	class FixedArray {
+	public:
+		FixedArray() : fData(nullptr), fCount(0), fSwapped(false) {}
+
+		int32 CountItems() const { return fCount; }
+		T ItemAt(int32 index, T defaultValue = T()) const;
+
+	private:
+		friend class BackgroundInfoReader;
+
+		const uint8* fData;
+		int32 fCount;
+		bool fSwapped;
+	};
+
+	class StringArray {
+	public:
+		StringArray() : fData(nullptr), fSize(0), fCount(0), fSwapped(false) {}
+
+		int32 CountItems() const { return fCount; }
+		std::string_view ItemAt(int32 index, std::string_view defaultValue = {}) const;
+
+	private:
+		friend class BackgroundInfoReader;
+
+		const uint8* fData;
+		uint32 fSize;
+		int32 fCount;
+		bool fSwapped;
+	};
+
+	BackgroundInfoReader();
+	BackgroundInfoReader(const void* buffer, size_t size);
+
+	status_t SetTo(const void* buffer, size_t size);
+	void Unset();
+	status_t InitCheck() const;
+
+	uint32 What() const { return fWhat; }
+
+	const FixedArray<int32>& Workspaces() const { return fWorkspaces; }
+	const StringArray& Images() const { return fImages; }
+	const FixedArray<int32>& Modes() const { return fModes; }
+	const FixedArray<background_origin>& Origins() const { return fOrigins; }
+	const FixedArray<bool>& EraseText() const { return fEraseText; }
+	const FixedArray<int32>& SetFlags() const { return fSetFlags; }
+
+	static uint64 HashData(const void* data, size_t size);
+
+private:
+	template<typename T>
+	status_t _SetFixedArray(FixedArray<T>& array, type_code wantedType, uint16 flags, type_code type, int32 count,
+		const uint8* data, uint32 dataSize);
+	status_t _SetStringArray(StringArray& array, uint16 flags, type_code type, int32 count,
+		const uint8* data, uint32 dataSize);
+
+	uint16 _Read16(const uint8* data) const;
+	uint32 _Read32(const uint8* data) const;
+
+	static void _SwapWords(void* data, size_t size);
+
+	FixedArray<int32> fWorkspaces;
+	StringArray fImages;
+	FixedArray<int32> fModes;
+	FixedArray<background_origin> fOrigins;
+	FixedArray<bool> fEraseText;
+	FixedArray<int32> fSetFlags;
+	uint32 fWhat;
+	bool fSwapped;
+	status_t fInitStatus;
+};
+
+
+template<typename T>
+T
+BackgroundInfoReader::FixedArray<T>::ItemAt(int32 index, T defaultValue) const
+{
+	if (index < 0 || index >= fCount)
+		return defaultValue;
+
+	T value;
+	memcpy(&value, fData + index * sizeof(T), sizeof(T));
+	if (fSwapped)
+		_SwapWords(&value, sizeof(T));
+
+	return value;
+}
@@ -4,28 +4,53 @@
 
 #include "BackgroundManager.h"
 
+#include <ByteOrder.h>
 #include <FindDirectory.h>
+#include <Message.h>
 #include <Messenger.h>
-#include <Node.h>
 #include <Path.h>
-#include <Screen.h>
 #include <String.h>
 #include <be_apps/Tracker/Background.h>
+#include <cstring>
 #include <iostream>
-#include <kernel/fs_attr.h>
 #include <private/shared/AutoDeleter.h>
+#include <vector>
 
-#define BACKGROUND_SET "be:bgndimginfoset"
 
+static const uint32 kSnapshotMagic = 'BGSS';
+static const uint32 kSnapshotVersion = 1;
 
-BackgroundManager::BackgroundManager(const char* path) :
+// the integers are little endian, the flattened B_BACKGROUND_INFO message follows the header
+struct snapshot_header {
+	uint32 magic;
+	uint32 version;
+	uint32 flatSize;
+	rgb_color colors[BackgroundManager::kMaxWorkspaces];
+};
+
+static_assert(sizeof(snapshot_header) == 140, "snapshot header must not contain padding");
+
+
+BackgroundManager::BackgroundManager(const char* path, PhaseTimings* timings) :
+	fFlatBuffer(nullptr),
+	fFlatSize(0),
+	fFlatHash(0),
 	fBackgroundMessage(nullptr),
-	fFolderNode(nullptr),
+	fTransactionSet(nullptr),
+	fTransactionDirty(0),
+	fTransactionColorsLoaded(false),
+	fTransactionDirtyColors(0),
+	fStorage(nullptr),
 	fInitStatus(B_NO_INIT),
-	fDirtyMessage(false)
+	fDirtyWorkspaces(0),
+	fScreen(nullptr),
+	fDesktopColorsLoaded(false),
+	fDirtyColors(0),
+	fTimings(timings)
 {
 	BPath folderPath;
 	if (path == nullptr) {
+		PhaseTimer timer(fTimings, "find_directory");
 		if (find_directory(B_DESKTOP_DIRECTORY, &folderPath) != B_OK) {
 			std::cerr << "Error: unable to find B_DESKTOP_DIRECTORY" << std::endl;
 			return;
@@ -33,40 +58,27 @@ BackgroundManager::BackgroundManager(const char* path) :
 	} else
 		folderPath.SetTo(path);
 
-	fFolderNode = new BNode(folderPath.Path());
-	if (fFolderNode->InitCheck() != B_OK) {
+	{
+		PhaseTimer timer(fTimings, "open node");
+		fStorage = new NodeBackgroundStorage(folderPath.Path());
+	}
+	if (fStorage->InitCheck() != B_OK) {
 		// TODO better message for file not found
 		std::cerr << "Error: unable to create BNode for folder" << std::endl;
 		return;
 	}
 
-	attr_info info;
-	if (fFolderNode->GetAttrInfo(B_BACKGROUND_INFO, &info) != B_OK)
-		return;
-
-	char* flatBuffer = new char[info.size];
-	ArrayDeleter<char> _(flatBuffer);
-	ssize_t bytesRead = fFolderNode->ReadAttr(B_BACKGROUND_INFO, B_MESSAGE_TYPE, 0, flatBuffer, info.size);
-
-	if (bytesRead != info.size) {
-		std::cerr << "Error: unable to read B_BACKGROUND_INFO from node" << std::endl;
-		return;
-	}
-
-	fBackgroundMessage = new BMessage();
-	if (fBackgroundMessage->Unflatten(flatBuffer) != B_OK) {
-		std::cerr << "Error: unable to unflatten message" << std::endl;
-		return;
-	}
-
-	fInitStatus = B_OK;
+	fInitStatus = _Load();
 }
 
 
 BackgroundManager::~BackgroundManager()
 {
+	delete fTransactionSet;
 	delete fBackgroundMessage;
-	delete fFolderNode;
+	delete[] fFlatBuffer;
+	delete fStorage;
+	delete fScreen;
 }
 
 
@@ -78,40 +90,88 @@ BackgroundManager::InitCheck()
 
 
 status_t
-BackgroundManager::_RemoveWorkspaceIndex(int32 workspace)
+BackgroundManager::Reload()
 {
-	int32 messageIndex = _FindWorkspaceIndex(workspace, false);
-	// we don't allow removing workspace 0
-	if (messageIndex < B_OK || workspace == 0) {
-		std::cerr << "Error: invalid workspace #" << std::endl;
-		return B_BAD_VALUE;
+	if (fStorage == nullptr || fStorage->InitCheck() != B_OK)
+		return B_NO_INIT;
+
+	if (fTransactionSet != nullptr) {
+		std::cerr << "Error: unable to reload while a transaction is in progress" << std::endl;
+		return B_BUSY;
 	}
 
-	int32 setWorkspaces = fBackgroundMessage->GetInt32(B_BACKGROUND_WORKSPACES, messageIndex, 0);
-	// clear the bit for this workspace
-	setWorkspaces &= ~(1 << (workspace - 1));
-	if (setWorkspaces != 0) {
-		// some other workspace is using this index, keep it around
-		fBackgroundMessage->ReplaceInt32(B_BACKGROUND_WORKSPACES, messageIndex, setWorkspaces);
-	} else {
-		// the index is no longer used, remove it
-		fBackgroundMessage->RemoveData(B_BACKGROUND_WORKSPACES, messageIndex);
-		fBackgroundMessage->RemoveData(B_BACKGROUND_IMAGE, messageIndex);
-		fBackgroundMessage->RemoveData(B_BACKGROUND_MODE, messageIndex);
-		fBackgroundMessage->RemoveData(B_BACKGROUND_ORIGIN, messageIndex);
-		fBackgroundMessage->RemoveData(B_BACKGROUND_ERASE_TEXT, messageIndex);
-		fBackgroundMessage->RemoveData(BACKGROUND_SET, messageIndex);
+	// throw away everything read earlier, including changes which haven't been flushed
+	delete fBackgroundMessage;
+	fBackgroundMessage = nullptr;
+	delete[] fFlatBuffer;
+	fFlatBuffer = nullptr;
+	fFlatSize = 0;
+	fFlatHash = 0;
+	fBackgroundSet.MakeEmpty();
+	fDirtyWorkspaces = 0;
+	fDesktopColorsLoaded = false;
+	fDirtyColors = 0;
+
+	fInitStatus = _Load();
+
+	return fInitStatus;
+}
+
+
+status_t
+BackgroundManager::_Load()
+{
+	{
+		PhaseTimer timer(fTimings, "read attribute");
+		ssize_t size = fStorage->Size();
+		if (size < B_OK)
+			return size;
+
+		// keep the flattened data around, it is only unflattened if we need to write changes
+		fFlatBuffer = new char[size];
+		ssize_t bytesRead = fStorage->Read(fFlatBuffer, size);
+
+		if (bytesRead != size) {
+			std::cerr << "Error: unable to read B_BACKGROUND_INFO from node" << std::endl;
+			return B_ERROR;
+		}
+
+		fFlatSize = size;
 	}
 
-	if (fBackgroundMessage->FindInt32(B_BACKGROUND_WORKSPACES, 0, &setWorkspaces) != B_OK) {
-		std::cerr << "Error: Unable to find B_BACKGROUND_WORKSPACES for index 0" << std::endl;
+	BackgroundInfoReader reader;
+	{
+		PhaseTimer timer(fTimings, "parse");
+		fFlatHash = BackgroundInfoReader::HashData(fFlatBuffer, fFlatSize);
+
+		reader.SetTo(fFlatBuffer, fFlatSize);
+		if (reader.InitCheck() != B_BAD_TYPE) {
+			if (fBackgroundSet.SetTo(reader) != B_OK) {
+				std::cerr << "Error: unable to parse B_BACKGROUND_INFO message" << std::endl;
+				return B_ERROR;
+			}
+
+			return B_OK;
+		}
+	}
+
+	// an old message format, let BMessage convert it and parse the native version.  _Message()
+	// has a phase of its own, nesting it in another one would count it twice in the total.
+	if (_Message() == nullptr)
+		return B_ERROR;
+
+	PhaseTimer timer(fTimings, "convert");
+	ssize_t flatSize = fBackgroundMessage->FlattenedSize();
+	char* flatBuffer = new char[flatSize];
+	ArrayDeleter<char> _(flatBuffer);
+	if (fBackgroundMessage->Flatten(flatBuffer, flatSize) != B_OK) {
+		std::cerr << "Error: unable to flatten background message" << std::endl;
 		return B_ERROR;
 	}
 
-	// tell Tracker that this workspace uses the global background
-	setWorkspaces |= (1 << (workspace - 1));
-	if (fBackgroundMessage->ReplaceInt32(B_BACKGROUND_WORKSPACES, 0, setWorkspaces) != B_OK) {
-		std::cerr << "Error: Unable to replace B_BACKGROUND_WORKSPACES for index 0" << std::endl;
+	reader.SetTo(flatBuffer, flatSize);
+	if (fBackgroundSet.SetTo(reader) != B_OK) {
+		std::cerr << "Error: unable to parse B_BACKGROUND_INFO message" << std::endl;
 		return B_ERROR;
 	}
 
@@ -119,6 +179,28 @@ BackgroundManager::_RemoveWorkspaceIndex(int32 workspace)
 }
 
 
+BMessage*
+BackgroundManager::_Message()
+{
+	// the BMessage is only unflattened when writing, to carry over fields we don't know about
+	if (fBackgroundMessage != nullptr)
+		return fBackgroundMessage;
+
+	if (fFlatBuffer == nullptr)
+		return nullptr;
+
+	PhaseTimer timer(fTimings, "unflatten");
+	fBackgroundMessage = new BMessage();
+	if (fBackgroundMessage->Unflatten(fFlatBuffer) != B_OK) {
+		std::cerr << "Error: unable to unflatten message" << std::endl;
+		delete fBackgroundMessage;
+		fBackgroundMessage = nullptr;
+	}
+
+	return fBackgroundMessage;
+}
+
+
 int32
 BackgroundManager::_FindWorkspaceIndex(int32 workspace, bool create)
 {
@@ -127,92 +209,316 @@ BackgroundManager::_FindWorkspaceIndex(int32 workspace, bool create)
 		return B_BAD_VALUE;
 	}
 
-	// we're adjusting the global/default background
-	if (workspace == 0)
-		return 0;
-
-	int32 countFound = 0;
-	fBackgroundMessage->GetInfo(B_BACKGROUND_WORKSPACES, nullptr, &countFound);
-	for (int32 x = 1; x < countFound; x++) {
-		int32 workspaces = 0;
-		if (fBackgroundMessage->FindInt32(B_BACKGROUND_WORKSPACES, x, &workspaces) != B_OK) {
-			std::cerr << "Error: Unable to find B_BACKGROUND_WORKSPACES for index " << x << std::endl;
+	int32 index = fBackgroundSet.IndexFor(workspace);
+	if (index > 0 && create) {
+		// the index may be shared with other workspaces, split it off before it gets modified
+		index = fBackgroundSet.DetachIndex(workspace);
+		if (index < B_OK)
+			std::cerr << "Error: unable to create index for workspace " << workspace << std::endl;
+		return index;
+	}
+	if (index >= 0)
+		return index;
+
+	// return an error if we didn't find it because we have a global background or a single workspace or ...
+	if (!create)
+		return B_ERROR;
+
+	// we're switching from global to a locally set background, create a new index
+	index = fBackgroundSet.CreateIndex(workspace);
+	if (index < B_OK)
+		std::cerr << "Error: unable to create index for workspace " << workspace << std::endl;
+
+	return index;
+}
+
+
+status_t
+BackgroundManager::_WriteMessage(bool* _written)
+{
+	*_written = false;
+
+	BMessage* message = _Message();
+	if (message == nullptr)
+		return B_NO_INIT;
+
+	{
+		PhaseTimer timer(fTimings, "build message");
+
+		// replace our fields in the original message so any extra fields are kept
+		message->RemoveName(B_BACKGROUND_WORKSPACES);
+		message->RemoveName(B_BACKGROUND_IMAGE);
+		message->RemoveName(B_BACKGROUND_MODE);
+		message->RemoveName(B_BACKGROUND_ORIGIN);
+		message->RemoveName(B_BACKGROUND_ERASE_TEXT);
+		message->RemoveName(BACKGROUND_SET);
+
+		for (int32 x = 0; x < fBackgroundSet.CountIndices(); x++) {
+			background_origin origin = fBackgroundSet.OriginAt(x);
+			if (message->AddInt32(B_BACKGROUND_WORKSPACES, fBackgroundSet.WorkspacesAt(x)) != B_OK
+				|| message->AddString(B_BACKGROUND_IMAGE, fBackgroundSet.PathAt(x).c_str()) != B_OK
+				|| message->AddInt32(B_BACKGROUND_MODE, fBackgroundSet.ModeAt(x)) != B_OK
+				|| message->AddPoint(B_BACKGROUND_ORIGIN, BPoint(origin.x, origin.y)) != B_OK
+				|| message->AddBool(B_BACKGROUND_ERASE_TEXT, fBackgroundSet.EraseAt(x)) != B_OK
+				|| message->AddInt32(BACKGROUND_SET, fBackgroundSet.SetFlagAt(x)) != B_OK) {
+				std::cerr << "Error: unable to build new background message" << std::endl;
+				return B_ERROR;
+			}
+		}
+	}
+
+	ssize_t flatSize = message->FlattenedSize();
+	char* flatBuffer = new char[flatSize];
+	ArrayDeleter<char> flatDeleter(flatBuffer);
+
+	uint64 flatHash;
+	{
+		PhaseTimer timer(fTimings, "flatten");
+		if (message->Flatten(flatBuffer, flatSize) != B_OK) {
+			std::cerr << "Error: unable to flatten new background message" << std::endl;
 			return B_ERROR;
 		}
 
-		// check if our workspace bit is set in this index
-		if ((1 << (workspace - 1)) & workspaces)
-			return x;
+		flatHash = BackgroundInfoReader::HashData(flatBuffer, flatSize);
 	}
 
-	// return an error if we didn't find it because we have a global background or a single workspace or ...
-	if (!create)
+	// don't bother Tracker if the changes ended up being the same as what is stored
+	if (flatSize == fFlatSize && flatHash == fFlatHash)
+		return B_OK;
+
+	PhaseTimer timer(fTimings, "write attribute");
+	if (fStorage->Write(flatBuffer, flatSize) != flatSize) {
+		std::cerr << "Error: unable to write message to node" << std::endl;
 		return B_ERROR;
+	}
+
+	// keep what was written, ExportSnapshot() copies it as is
+	delete[] fFlatBuffer;
+	fFlatBuffer = flatDeleter.Detach();
+	fFlatSize = flatSize;
+	fFlatHash = flatHash;
+	*_written = true;
 
-	// we're switching from global to a locally set background, find the next free index
-	return _CreateWorkspaceIndex(workspace);
+	return B_OK;
 }
 
 
-int32
-BackgroundManager::_CreateWorkspaceIndex(int32 workspace)
+BScreen*
+BackgroundManager::_Screen()
 {
-	// start at 1 because we don't allow creating workspace 0
-	if (workspace < 1 || workspace > 32) {
-		std::cerr << "Error: invalid workspace #" << std::endl;
-		return B_BAD_VALUE;
+	// only connects to the app_server when colors are used
+	if (fScreen == nullptr)
+		fScreen = new BScreen();
+
+	if (!fScreen->IsValid()) {
+		std::cerr << "Error: unable to get BScreen" << std::endl;
+		return nullptr;
 	}
 
-	int32 setWorkspaces = 0;
-	if (fBackgroundMessage->FindInt32(B_BACKGROUND_WORKSPACES, 0, &setWorkspaces) != B_OK) {
-		std::cerr << "Error: Unable to find B_BACKGROUND_WORKSPACES for index 0" << std::endl;
+	return fScreen;
+}
+
+
+status_t
+BackgroundManager::_LoadDesktopColors()
+{
+	if (fDesktopColorsLoaded)
+		return B_OK;
+
+	PhaseTimer timer(fTimings, "read colors");
+	BScreen* screen = _Screen();
+	if (screen == nullptr)
 		return B_ERROR;
+
+	// fetch every workspace at once instead of asking the app_server on each lookup
+	for (int32 x = 0; x < kMaxWorkspaces; x++)
+		fDesktopColors[x] = screen->DesktopColor(x);
+
+	fDesktopColorsLoaded = true;
+	return B_OK;
+}
+
+
+void
+BackgroundManager::InvalidateDesktopColors()
+{
+	// changes waiting for Flush() would be lost
+	if (fDirtyColors == 0)
+		fDesktopColorsLoaded = false;
+}
+
+
+void
+BackgroundManager::_WriteDesktopColors()
+{
+	if (fDirtyColors == 0)
+		return;
+
+	PhaseTimer timer(fTimings, "write colors");
+	BScreen* screen = _Screen();
+	if (screen == nullptr)
+		return;
+
+	for (int32 x = 0; x < kMaxWorkspaces; x++) {
+		if ((fDirtyColors & (1u << x)) != 0)
+			screen->SetDesktopColor(fDesktopColors[x], x, true);
 	}
 
-	// TODO verify the new workspace is in setWorkspaces before trying to clear the bit
+	fDirtyColors = 0;
+}
+
 
-	// tell Tracker that this workspace has a custom background
-	setWorkspaces &= ~(1 << (workspace - 1));
-	if (fBackgroundMessage->ReplaceInt32(B_BACKGROUND_WORKSPACES, 0, setWorkspaces) != B_OK) {
-		std::cerr << "Error: Unable to replace B_BACKGROUND_WORKSPACES for index 0" << std::endl;
+status_t
+BackgroundManager::_ResolvePath(const char* imagePath, BString& resolvedPath)
+{
+	resolvedPath = imagePath;
+
+	// an empty path clears the background
+	if (resolvedPath.IsEmpty())
+		return B_OK;
+
+	// each distinct path only hits the filesystem once per transaction
+	std::unordered_map<std::string, std::string>::const_iterator cached = fPathCache.find(imagePath);
+	if (cached != fPathCache.end()) {
+		resolvedPath = cached->second.c_str();
+		return B_OK;
+	}
+
+	PhaseTimer timer(fTimings, "resolve path");
+
+	// verify the file exists
+	BEntry newWallEntry(resolvedPath.String());
+	if (newWallEntry.InitCheck() != B_OK || !newWallEntry.Exists() || !newWallEntry.IsFile()) {
+		std::cerr << "Error: invalid file path" << std::endl;
 		return B_ERROR;
 	}
 
-	int32 countFound = B_ERROR;
-	fBackgroundMessage->GetInfo(B_BACKGROUND_WORKSPACES, nullptr, &countFound);
-	// start at 1 because there should already be at least one index for workspace 0
-	if (countFound < 1)
+	// convert to an absolute path if it isn't already
+	if (resolvedPath[0] != '/') {
+		BPath absolutePath(&newWallEntry);
+		if (absolutePath.InitCheck() != B_OK) {
+			std::cerr << "Error: unable to get full path to file" << std::endl;
+			return B_ERROR;
+		}
+		resolvedPath = absolutePath.Path();
+	}
+
+	// files may be deleted at any time, only remember them until the transaction ends
+	if (fTransactionSet != nullptr)
+		fPathCache.emplace(imagePath, resolvedPath.String());
+
+	return B_OK;
+}
+
+
+void
+BackgroundManager::_MarkDirty(int32 workspace)
+{
+	// a change to the global default shows up on every workspace following it
+	if (workspace == 0)
+		fDirtyWorkspaces |= 1 | ((uint64)fBackgroundSet.WorkspacesAt(0) << 1);
+	else
+		fDirtyWorkspaces |= (uint64)1 << workspace;
+}
+
+
+status_t
+BackgroundManager::_SetImage(const char* resolvedPath, int32 workspace)
+{
+	int32 messageIndex = _FindWorkspaceIndex(workspace);
+	if (messageIndex == B_BAD_VALUE)
+		return messageIndex;
+
+	// nothing to do if the workspace already has its own copy of this value
+	if (messageIndex >= 0 && fBackgroundSet.PathAt(messageIndex) == resolvedPath)
+		return B_OK;
+
+	messageIndex = _FindWorkspaceIndex(workspace, true);
+	if (messageIndex < B_OK)
+		return messageIndex;
+
+	if (fBackgroundSet.SetPathAt(messageIndex, resolvedPath) != B_OK) {
+		std::cerr << "Error: unable to replace background image path" << std::endl;
 		return B_ERROR;
+	}
+
+	_MarkDirty(workspace);
+	return B_OK;
+}
+
+
+status_t
+BackgroundManager::_SetMode(int32 mode, int32 workspace)
+{
+	int32 messageIndex = _FindWorkspaceIndex(workspace);
+	if (messageIndex == B_BAD_VALUE)
+		return messageIndex;
+
+	// nothing to do if the workspace already has its own copy of this value
+	if (messageIndex >= 0 && fBackgroundSet.ModeAt(messageIndex) == mode)
+		return B_OK;
 
-	// get our default values from index 0
-	fBackgroundMessage->AddInt32(B_BACKGROUND_WORKSPACES, (1 << (workspace - 1)));
-	fBackgroundMessage->AddString(B_BACKGROUND_IMAGE, fBackgroundMessage->GetString(B_BACKGROUND_IMAGE, 0, ""));
-	fBackgroundMessage->AddInt32(B_BACKGROUND_MODE, fBackgroundMessage->GetInt32(B_BACKGROUND_MODE, 0, B_BACKGROUND_MODE_SCALED));
-	fBackgroundMessage->AddPoint(B_BACKGROUND_ORIGIN, fBackgroundMessage->GetPoint(B_BACKGROUND_ORIGIN, 0, BPoint(0, 0)));
-	fBackgroundMessage->AddBool(B_BACKGROUND_ERASE_TEXT, fBackgroundMessage->GetBool(B_BACKGROUND_ERASE_TEXT, 0, true));
-	fBackgroundMessage->AddInt32(BACKGROUND_SET, 0);
+	messageIndex = _FindWorkspaceIndex(workspace, true);
+	if (messageIndex < B_OK)
+		return messageIndex;
+
+	if (fBackgroundSet.SetModeAt(messageIndex, mode) != B_OK) {
+		std::cerr << "Error: unable to replace background mode" << std::endl;
+		return B_ERROR;
+	}
 
-	// countFound will be our new message index
-	return countFound;
+	_MarkDirty(workspace);
+	return B_OK;
 }
 
 
 status_t
-BackgroundManager::_WriteMessage()
+BackgroundManager::_SetOutline(bool enabled, int32 workspace)
 {
-	ssize_t flatSize = fBackgroundMessage->FlattenedSize();
-	char* flatBuffer = new char[flatSize];
-	ArrayDeleter<char> _(flatBuffer);
+	int32 messageIndex = _FindWorkspaceIndex(workspace);
+	if (messageIndex == B_BAD_VALUE)
+		return messageIndex;
 
-	if (fBackgroundMessage->Flatten(flatBuffer, flatSize) != B_OK) {
-		std::cerr << "Error: unable to flatten new background message" << std::endl;
+	// nothing to do if the workspace already has its own copy of this value
+	if (messageIndex >= 0 && fBackgroundSet.EraseAt(messageIndex) == enabled)
+		return B_OK;
+
+	messageIndex = _FindWorkspaceIndex(workspace, true);
+	if (messageIndex < B_OK)
+		return messageIndex;
+
+	if (fBackgroundSet.SetEraseAt(messageIndex, enabled) != B_OK) {
+		std::cerr << "Error: unable to replace outline mode" << std::endl;
 		return B_ERROR;
 	}
 
-	if (fFolderNode->WriteAttr(B_BACKGROUND_INFO, B_MESSAGE_TYPE, 0, flatBuffer, flatSize) < B_OK) {
-		std::cerr << "Error: unable to write message to node" << std::endl;
+	_MarkDirty(workspace);
+	return B_OK;
+}
+
+
+status_t
+BackgroundManager::_SetOffset(BPoint offset, int32 workspace)
+{
+	int32 messageIndex = _FindWorkspaceIndex(workspace);
+	if (messageIndex == B_BAD_VALUE)
+		return messageIndex;
+
+	// nothing to do if the workspace already has its own copy of this value
+	if (messageIndex >= 0 && fBackgroundSet.OriginAt(messageIndex).x == offset.x
+		&& fBackgroundSet.OriginAt(messageIndex).y == offset.y)
+		return B_OK;
+
+	messageIndex = _FindWorkspaceIndex(workspace, true);
+	if (messageIndex < B_OK)
+		return messageIndex;
+
+	if (fBackgroundSet.SetOriginAt(messageIndex, (background_origin){offset.x, offset.y}) != B_OK) {
+		std::cerr << "Error: unable to replace offset" << std::endl;
 		return B_ERROR;
 	}
+
+	_MarkDirty(workspace);
 	return B_OK;
 }
 
@@ -225,23 +531,50 @@ BackgroundManager::GetWorkspaceInfo(int32 workspace, BString& path, int32* mode,
 	if (messageIndex < 0)
 		messageIndex = 0;
 
-	if (fBackgroundMessage->FindString(B_BACKGROUND_IMAGE, messageIndex, &path) != B_OK) {
-		// message index has been deleted?
-		std::cerr << "File: Index not found in BMessage!" << std::endl;
-		return B_ERROR;
+	path = fBackgroundSet.PathAt(messageIndex).c_str();
+
+	if (mode != nullptr)
+		*mode = fBackgroundSet.ModeAt(messageIndex);
+
+	if (offset != nullptr) {
+		background_origin origin = fBackgroundSet.OriginAt(messageIndex);
+		*offset = BPoint(origin.x, origin.y);
 	}
 
-	if (mode != nullptr && fBackgroundMessage->FindInt32(B_BACKGROUND_MODE, messageIndex, mode) != B_OK)
-		std::cerr << "Background Mode: Not found, using default!" << std::endl;
+	if (erase != nullptr)
+		*erase = fBackgroundSet.EraseAt(messageIndex);
+
+	if (workspace > 0 && workspace <= kMaxWorkspaces && color != nullptr
+		&& _LoadDesktopColors() == B_OK)
+		*color = fDesktopColors[workspace - 1];
 
-	if (offset != nullptr && fBackgroundMessage->FindPoint(B_BACKGROUND_ORIGIN, messageIndex, offset) != B_OK)
-		std::cerr << "Offset: Not found, using default!" << std::endl;
+	return B_OK;
+}
 
-	if (erase != nullptr && fBackgroundMessage->FindBool(B_BACKGROUND_ERASE_TEXT, messageIndex, erase) != B_OK)
-		std::cerr << "Text Outline: Not found, using default!" << std::endl;
 
-	if (workspace != 0 && color != nullptr && BScreen().IsValid())
-		*color = BScreen().DesktopColor(workspace - 1);
+status_t
+BackgroundManager::GetAllWorkspaceInfo(workspace_info info[33])
+{
+	bool haveColors = _LoadDesktopColors() == B_OK;
+
+	for (int32 workspace = 0; workspace <= 32; workspace++) {
+		// use the global defaults for workspaces without customization
+		int32 messageIndex = fBackgroundSet.IndexFor(workspace);
+		info[workspace].followsDefault = messageIndex <= 0;
+		if (messageIndex < 0)
+			messageIndex = 0;
+
+		background_origin origin = fBackgroundSet.OriginAt(messageIndex);
+		info[workspace].path = fBackgroundSet.PathAt(messageIndex).c_str();
+		info[workspace].mode = fBackgroundSet.ModeAt(messageIndex);
+		info[workspace].offset = BPoint(origin.x, origin.y);
+		info[workspace].erase = fBackgroundSet.EraseAt(messageIndex);
+
+		if (workspace > 0 && haveColors)
+			info[workspace].color = fDesktopColors[workspace - 1];
+		else
+			info[workspace].color = (rgb_color){0, 0, 0, 255};
+	}
 
 	return B_OK;
 }
@@ -250,70 +583,77 @@ BackgroundManager::GetWorkspaceInfo(int32 workspace, BString& path, int32* mode,
 status_t
 BackgroundManager::PrintBackgroundToStream(int32 workspace, bool verbose)
 {
-	BString path;
-	int32 mode = B_BACKGROUND_MODE_SCALED;
-	BPoint offset;
-	bool erase = true;
-	rgb_color color;
+	if (workspace < 0 || workspace > 32) {
+		std::cerr << "Error: invalid workspace #" << std::endl;
+		return B_BAD_VALUE;
+	}
 
-	if (GetWorkspaceInfo(workspace, path, &mode, &offset, &erase, &color) != B_OK)
+	workspace_info info[33];
+	if (GetAllWorkspaceInfo(info) != B_OK)
 		return B_ERROR;
 
+	return PrintBackgroundToStream(workspace, info[workspace], verbose);
+}
+
+
+status_t
+BackgroundManager::PrintBackgroundToStream(int32 workspace, const workspace_info& info, bool verbose)
+{
 	if (verbose) {
 		std::cout << "Workspace: " << workspace;
 		if (workspace == 0)
 			std::cout << " *Global Default*";
-		else if (_FindWorkspaceIndex(workspace) < B_OK)
+		else if (info.followsDefault)
 			std::cout << " **Warning: No custom settings.  Showing Global Defaults**";
-		std::cout << std::endl;
+		std::cout << "\n";
 	} else {
 		// mark the global workspace and workspaces which are using it with an asterisk
 		std::cout << workspace;
-		if (workspace == 0 || _FindWorkspaceIndex(workspace) < B_OK)
+		if (info.followsDefault)
 			std::cout << "*";
 		std::cout << ": ";
 	}
 
-	if (path.IsEmpty()) {
+	if (info.path[0] == '\0') {
 		if (verbose)
-			std::cout << "File: No background set!" << std::endl;
+			std::cout << "File: No background set!\n";
 		else {
-			std::cout << "<none>" << std::endl;
+			std::cout << "<none>\n";
 			return B_OK;
 		}
 	} else if (!verbose) {
-		std::cout << path << std::endl;
+		std::cout << info.path << "\n";
 		return B_OK;
 	} else {
-		std::cout << "File: " << path << std::endl;
+		std::cout << "File: " << info.path << "\n";
 	}
 
-	switch (mode) {
+	switch (info.mode) {
 		case B_BACKGROUND_MODE_USE_ORIGIN:
-			std::cout << "Mode: Use Origin" << std::endl;
+			std::cout << "Mode: Use Origin\n";
 			break;
 		case B_BACKGROUND_MODE_CENTERED:
-			std::cout << "Mode: Centered" << std::endl;
+			std::cout << "Mode: Centered\n";
 			break;
 		case B_BACKGROUND_MODE_SCALED:
-			std::cout << "Mode: Scaled" << std::endl;
+			std::cout << "Mode: Scaled\n";
 			break;
 		case B_BACKGROUND_MODE_TILED:
-			std::cout << "Mode: Tiled" << std::endl;
+			std::cout << "Mode: Tiled\n";
 			break;
 		default:
-			std::cout << "Mode: Unknown" << std::endl;
+			std::cout << "Mode: Unknown\n";
 			break;
 	}
 
-	std::cout << "Offset: X=" << offset.x << " Y=" << offset.y << std::endl;
+	std::cout << "Offset: X=" << info.offset.x << " Y=" << info.offset.y << "\n";
 
-	std::cout << "Text Outline: " << (erase ? "true" : "false") << std::endl;
+	std::cout << "Text Outline: " << (info.erase ? "true" : "false") << "\n";
 
 	if (workspace != 0)
-		std::cout << "Background Color: {r:" << +color.red << ",g:" << +color.green << ",b:" << +color.blue << "}" << std::endl;
+		std::cout << "Background Color: {r:" << +info.color.red << ",g:" << +info.color.green << ",b:" << +info.color.blue << "}\n";
 
-	std::cout << std::endl;
+	std::cout << "\n";
 
 	return B_OK;
 }
@@ -322,10 +662,18 @@ BackgroundManager::PrintBackgroundToStream(int32 workspace, bool verbose)
 status_t
 BackgroundManager::ResetWorkspace(int32 workspace)
 {
-	if (status_t status = _RemoveWorkspaceIndex(workspace) != B_OK)
-		return status;
+	// we don't allow removing workspace 0
+	if (workspace == 0 || _FindWorkspaceIndex(workspace) < B_OK) {
+		std::cerr << "Error: invalid workspace #" << std::endl;
+		return B_BAD_VALUE;
+	}
+
+	if (fBackgroundSet.RemoveWorkspace(workspace) != B_OK) {
+		std::cerr << "Error: unable to remove index for workspace " << workspace << std::endl;
+		return B_ERROR;
+	}
 
-	fDirtyMessage = true;
+	_MarkDirty(workspace);
 	return B_OK;
 }
 
@@ -333,38 +681,11 @@ BackgroundManager::ResetWorkspace(int32 workspace)
 status_t
 BackgroundManager::SetBackground(const char* imagePath, int32 workspace)
 {
-	int32 messageIndex = _FindWorkspaceIndex(workspace, true);
-	if (messageIndex < B_OK)
-		return messageIndex;
-
-	BString pathString(imagePath);
-
-	// verify the file exists if we were given a non-empty path
-	if (!pathString.IsEmpty()) {
-		BEntry newWallEntry(pathString.String());
-		if (newWallEntry.InitCheck() != B_OK || !newWallEntry.Exists() || !newWallEntry.IsFile()) {
-			std::cerr << "Error: invalid file path" << std::endl;
-			return B_ERROR;
-		}
-
-		// convert to an absolute path if it isn't already
-		if (pathString[0] != '/') {
-			BPath absolutePath(&newWallEntry);
-			if (absolutePath.InitCheck() != B_OK) {
-				std::cerr << "Error: unable to get full path to file" << std::endl;
-				return B_ERROR;
-			}
-			pathString = absolutePath.Path();
-		}
-	}
-
-	if (fBackgroundMessage->ReplaceString(B_BACKGROUND_IMAGE, messageIndex, pathString) != B_OK) {
-		std::cerr << "Error: unable to replace background image path in BMessage" << std::endl;
+	BString pathString;
+	if (_ResolvePath(imagePath, pathString) != B_OK)
 		return B_ERROR;
-	}
 
-	fDirtyMessage = true;
-	return B_OK;
+	return _SetImage(pathString.String(), workspace);
 }
 
 
@@ -378,86 +699,401 @@ BackgroundManager::SetPlacement(int32 mode, int32 workspace)
 		return B_BAD_VALUE;
 	}
 
-	int32 messageIndex = _FindWorkspaceIndex(workspace, true);
-	if (messageIndex < B_OK)
-		return messageIndex;
+	return _SetMode(mode, workspace);
+}
 
-	if (fBackgroundMessage->ReplaceInt32(B_BACKGROUND_MODE, messageIndex, mode) != B_OK) {
-		std::cerr << "Error: unable to replace background mode in BMessage" << std::endl;
-		return B_ERROR;
+
+status_t
+BackgroundManager::SetOutline(bool enabled, int32 workspace)
+{
+	return _SetOutline(enabled, workspace);
+}
+
+
+status_t
+BackgroundManager::SetOffset(int32 x, int32 y, int32 workspace)
+{
+	return _SetOffset(BPoint(x, y), workspace);
+}
+
+
+status_t
+BackgroundManager::SetColor(rgb_color color, int32 workspace)
+{
+	if (workspace < 1 || workspace > 32) {
+		std::cerr << "Error: invalid workspace #" << std::endl;
+		return B_BAD_VALUE;
 	}
+	if (_LoadDesktopColors() != B_OK)
+		return B_ERROR;
+
+	if (fDesktopColors[workspace - 1] == color)
+		return B_OK;
+
+	// sent to the screen together with the other changes in Flush()
+	fDesktopColors[workspace - 1] = color;
+	fDirtyColors |= 1u << (workspace - 1);
 
-	fDirtyMessage = true;
 	return B_OK;
 }
 
 
 status_t
-BackgroundManager::SetOutline(bool enabled, int32 workspace)
+BackgroundManager::Compact(int32* _merged)
 {
-	int32 messageIndex = _FindWorkspaceIndex(workspace, true);
-	if (messageIndex < B_OK)
-		return messageIndex;
+	int32 merged = fBackgroundSet.Compact();
+	// every customized workspace may have moved to a different index
+	if (merged > 0)
+		fDirtyWorkspaces |= (uint64)~fBackgroundSet.WorkspacesAt(0) << 1;
 
-	if (fBackgroundMessage->ReplaceBool(B_BACKGROUND_ERASE_TEXT, messageIndex, enabled) != B_OK) {
-		std::cerr << "Error: unable to replace outline mode in BMessage" << std::endl;
+	if (_merged != nullptr)
+		*_merged = merged;
+
+	return B_OK;
+}
+
+
+status_t
+BackgroundManager::Flush(uint64* _changedWorkspaces)
+{
+	if (_changedWorkspaces != nullptr)
+		*_changedWorkspaces = 0;
+
+	// colors are handled by the app_server, Tracker doesn't need to know about them
+	_WriteDesktopColors();
+
+	// nothing changed, no need to write or make Tracker reload the backgrounds
+	if (fDirtyWorkspaces == 0)
+		return B_OK;
+
+	// store workspaces with identical settings in a single index
+	fBackgroundSet.Compact();
+
+	bool written = false;
+	if (_WriteMessage(&written) != B_OK)
 		return B_ERROR;
+
+	uint64 changedWorkspaces = fDirtyWorkspaces;
+	fDirtyWorkspaces = 0;
+
+	// the changes cancelled each other out
+	if (!written)
+		return B_OK;
+
+	if (_changedWorkspaces != nullptr)
+		*_changedWorkspaces = changedWorkspaces;
+
+	return _NotifyTracker();
+}
+
+
+status_t
+BackgroundManager::ExportSnapshot(std::vector<char>& snapshot)
+{
+	if (fFlatBuffer == nullptr) {
+		std::cerr << "Error: there are no background settings to export" << std::endl;
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	// the snapshot is a copy of what is stored, changes which haven't been flushed would be missing
+	if (fDirtyWorkspaces != 0 || fDirtyColors != 0) {
+		std::cerr << "Error: unable to export settings which haven't been written yet" << std::endl;
+		return B_NOT_ALLOWED;
 	}
 
-	fDirtyMessage = true;
+	if (_LoadDesktopColors() != B_OK)
+		return B_ERROR;
+
+	snapshot_header header;
+	header.magic = B_HOST_TO_LENDIAN_INT32(kSnapshotMagic);
+	header.version = B_HOST_TO_LENDIAN_INT32(kSnapshotVersion);
+	header.flatSize = B_HOST_TO_LENDIAN_INT32(fFlatSize);
+	memcpy(header.colors, fDesktopColors, sizeof(header.colors));
+
+	snapshot.resize(sizeof(header) + fFlatSize);
+	memcpy(snapshot.data(), &header, sizeof(header));
+	memcpy(snapshot.data() + sizeof(header), fFlatBuffer, fFlatSize);
+
 	return B_OK;
 }
 
 
 status_t
-BackgroundManager::SetOffset(int32 x, int32 y, int32 workspace)
+BackgroundManager::ImportSnapshot(const void* data, size_t size)
 {
-	int32 messageIndex = _FindWorkspaceIndex(workspace, true);
-	if (messageIndex < B_OK)
-		return messageIndex;
+	if (fStorage == nullptr || fStorage->InitCheck() != B_OK)
+		return B_NO_INIT;
 
-	if (fBackgroundMessage->ReplacePoint(B_BACKGROUND_ORIGIN, messageIndex, BPoint(x, y)) != B_OK) {
-		std::cerr << "Error: unable to replace offset in BMessage" << std::endl;
-		return B_ERROR;
+	if (fTransactionSet != nullptr) {
+		std::cerr << "Error: unable to import while a transaction is in progress" << std::endl;
+		return B_BUSY;
 	}
 
-	fDirtyMessage = true;
+	snapshot_header header;
+	if (data == nullptr || size < sizeof(header)) {
+		std::cerr << "Error: invalid background snapshot" << std::endl;
+		return B_BAD_DATA;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (B_LENDIAN_TO_HOST_INT32(header.magic) != kSnapshotMagic
+		|| B_LENDIAN_TO_HOST_INT32(header.version) != kSnapshotVersion
+		|| B_LENDIAN_TO_HOST_INT32(header.flatSize) != size - sizeof(header)) {
+		std::cerr << "Error: invalid background snapshot" << std::endl;
+		return B_BAD_DATA;
+	}
+
+	const char* flatData = (const char*)data + sizeof(header);
+	ssize_t flatSize = size - sizeof(header);
+
+	// parse everything before touching the stored settings
+	BackgroundInfoReader reader(flatData, flatSize);
+	BackgroundSet backgroundSet;
+	if (backgroundSet.SetTo(reader) != B_OK) {
+		std::cerr << "Error: the snapshot doesn't contain valid background settings" << std::endl;
+		return B_BAD_DATA;
+	}
+
+	// written as is, Tracker is only bothered if something is different
+	uint64 flatHash = BackgroundInfoReader::HashData(flatData, flatSize);
+	bool written = false;
+	if (flatSize != fFlatSize || flatHash != fFlatHash) {
+		PhaseTimer timer(fTimings, "write attribute");
+		if (fStorage->Write(flatData, flatSize) != flatSize) {
+			std::cerr << "Error: unable to write message to node" << std::endl;
+			return B_ERROR;
+		}
+		written = true;
+	}
+
+	// only send the colors which are different from the current ones
+	InvalidateDesktopColors();
+	if (_LoadDesktopColors() == B_OK) {
+		for (int32 x = 0; x < kMaxWorkspaces; x++) {
+			if (fDesktopColors[x] != header.colors[x]) {
+				fDesktopColors[x] = header.colors[x];
+				fDirtyColors |= 1u << x;
+			}
+		}
+		_WriteDesktopColors();
+	}
+
+	// the new settings are already parsed, use them instead of reading the attribute again
+	char* flatBuffer = new char[flatSize];
+	memcpy(flatBuffer, flatData, flatSize);
+	delete fBackgroundMessage;
+	fBackgroundMessage = nullptr;
+	delete[] fFlatBuffer;
+	fFlatBuffer = flatBuffer;
+	fFlatSize = flatSize;
+	fFlatHash = flatHash;
+	fBackgroundSet = backgroundSet;
+	fDirtyWorkspaces = 0;
+	fInitStatus = B_OK;
+
+	if (!written)
+		return B_OK;
+
+	return _NotifyTracker();
+}
+
+
+status_t
+BackgroundManager::_NotifyTracker()
+{
+	PhaseTimer timer(fTimings, "notify Tracker");
+	return BMessenger("application/x-vnd.Be-TRAK").SendMessage(B_RESTORE_BACKGROUND_IMAGE);
+}
+
+
+status_t
+BackgroundManager::Begin()
+{
+	if (fTransactionSet != nullptr) {
+		std::cerr << "Error: a transaction is already in progress" << std::endl;
+		return B_BUSY;
+	}
+
+	// the colors may have been changed by the Backgrounds preferences since they were read
+	InvalidateDesktopColors();
+
+	fTransactionSet = new BackgroundSet(fBackgroundSet);
+	fTransactionDirty = fDirtyWorkspaces;
+	memcpy(fTransactionColors, fDesktopColors, sizeof(fDesktopColors));
+	fTransactionColorsLoaded = fDesktopColorsLoaded;
+	fTransactionDirtyColors = fDirtyColors;
+
 	return B_OK;
 }
 
 
 status_t
-BackgroundManager::SetColor(rgb_color color, int32 workspace)
+BackgroundManager::Apply(const background_edit* edits, int32 count)
 {
-	if (workspace < 1 || workspace > 32) {
-		std::cerr << "Error: invalid workspace #" << std::endl;
+	if (edits == nullptr || count < 0)
 		return B_BAD_VALUE;
+
+	// check everything before modifying anything
+	std::vector<BString> resolvedPaths(count);
+	for (int32 x = 0; x < count; x++) {
+		const background_edit& edit = edits[x];
+
+		if (edit.workspaces == 0 || (edit.workspaces >> 33) != 0) {
+			std::cerr << "Error: invalid workspace #" << std::endl;
+			return B_BAD_VALUE;
+		}
+
+		switch (edit.field) {
+			case kEditImage:
+				if (_ResolvePath(edit.path.String(), resolvedPaths[x]) != B_OK)
+					return B_ERROR;
+				break;
+			case kEditMode:
+				if (edit.mode != B_BACKGROUND_MODE_USE_ORIGIN && edit.mode != B_BACKGROUND_MODE_CENTERED
+					&& edit.mode != B_BACKGROUND_MODE_SCALED && edit.mode != B_BACKGROUND_MODE_TILED) {
+					std::cerr << "Error: invalid placement mode" << std::endl;
+					return B_BAD_VALUE;
+				}
+				break;
+			case kEditColor:
+			case kEditReset:
+				// the global default has no color and can't be reset
+				if ((edit.workspaces & 1) != 0) {
+					std::cerr << "Error: invalid workspace #" << std::endl;
+					return B_BAD_VALUE;
+				}
+				break;
+			case kEditOffset:
+			case kEditOutline:
+				break;
+			default:
+				return B_BAD_VALUE;
+		}
 	}
-	if (!BScreen().IsValid()) {
-		std::cerr << "Error: unable to get BScreen" << std::endl;
-		return B_ERROR;
+
+	for (int32 x = 0; x < count; x++) {
+		const background_edit& edit = edits[x];
+		for (int32 workspace = 0; workspace <= 32; workspace++) {
+			if ((edit.workspaces & ((uint64)1 << workspace)) == 0)
+				continue;
+
+			status_t status = B_OK;
+			switch (edit.field) {
+				case kEditImage:
+					status = _SetImage(resolvedPaths[x].String(), workspace);
+					break;
+				case kEditMode:
+					status = _SetMode(edit.mode, workspace);
+					break;
+				case kEditOffset:
+					status = _SetOffset(edit.offset, workspace);
+					break;
+				case kEditOutline:
+					status = _SetOutline(edit.outline, workspace);
+					break;
+				case kEditColor:
+					status = SetColor(edit.color, workspace);
+					break;
+				case kEditReset:
+					// nothing to do for workspaces already following the global default
+					if (_FindWorkspaceIndex(workspace) > 0)
+						status = ResetWorkspace(workspace);
+					break;
+			}
+
+			if (status != B_OK) {
+				// undo everything since Begin()
+				fPathCache.clear();
+				if (fTransactionSet != nullptr) {
+					fBackgroundSet = *fTransactionSet;
+					fDirtyWorkspaces = fTransactionDirty;
+					memcpy(fDesktopColors, fTransactionColors, sizeof(fDesktopColors));
+					fDesktopColorsLoaded = fTransactionColorsLoaded;
+					fDirtyColors = fTransactionDirtyColors;
+				}
+				return status;
+			}
+		}
 	}
 
-	BScreen().SetDesktopColor(color, (uint32)(workspace - 1));
+	return B_OK;
+}
+
+
+status_t
+BackgroundManager::Commit(uint64* _changedWorkspaces)
+{
+	delete fTransactionSet;
+	fTransactionSet = nullptr;
+	fPathCache.clear();
+
+	return Flush(_changedWorkspaces);
+}
+
+
+status_t
+BackgroundManager::AddEditsToMessage(const background_edit* edits, int32 count, BMessage* message)
+{
+	if (edits == nullptr || count < 0 || message == nullptr)
+		return B_BAD_VALUE;
+
+	// every edit adds all of its fields so they can be matched up again by index
+	for (int32 x = 0; x < count; x++) {
+		const background_edit& edit = edits[x];
+		if (message->AddInt64("workspaces", edit.workspaces) != B_OK
+			|| message->AddInt32("field", edit.field) != B_OK
+			|| message->AddString("path", edit.path) != B_OK
+			|| message->AddInt32("mode", edit.mode) != B_OK
+			|| message->AddPoint("offset", edit.offset) != B_OK
+			|| message->AddBool("outline", edit.outline) != B_OK
+			|| message->AddColor("color", edit.color) != B_OK) {
+			std::cerr << "Error: unable to add edits to message" << std::endl;
+			return B_ERROR;
+		}
+	}
 
 	return B_OK;
 }
 
 
 status_t
-BackgroundManager::Flush()
+BackgroundManager::GetEditsFromMessage(const BMessage* message, std::vector<background_edit>& edits)
 {
-	if (fDirtyMessage && _WriteMessage() != B_OK)
-		return B_ERROR;
+	if (message == nullptr)
+		return B_BAD_VALUE;
 
-	fDirtyMessage = false;
+	type_code type;
+	int32 count = 0;
+	if (message->GetInfo("workspaces", &type, &count) != B_OK)
+		return B_BAD_VALUE;
 
-	return BMessenger("application/x-vnd.Be-TRAK").SendMessage(B_RESTORE_BACKGROUND_IMAGE);
+	edits.clear();
+	for (int32 x = 0; x < count; x++) {
+		background_edit edit;
+		int64 workspaces;
+		int32 field;
+		if (message->FindInt64("workspaces", x, &workspaces) != B_OK
+			|| message->FindInt32("field", x, &field) != B_OK
+			|| message->FindString("path", x, &edit.path) != B_OK
+			|| message->FindInt32("mode", x, &edit.mode) != B_OK
+			|| message->FindPoint("offset", x, &edit.offset) != B_OK
+			|| message->FindBool("outline", x, &edit.outline) != B_OK
+			|| message->FindColor("color", x, &edit.color) != B_OK)
+			return B_BAD_VALUE;
+
+		// Apply() checks the workspaces and rejects unknown fields
+		edit.workspaces = workspaces;
+		edit.field = (background_field)field;
+		edits.push_back(edit);
+	}
+
+	return B_OK;
 }
 
 
 void
 BackgroundManager::PrintToStream()
 {
-	fBackgroundMessage->PrintToStream();
+	if (_Message() != nullptr)
+		fBackgroundMessage->PrintToStream();
 }
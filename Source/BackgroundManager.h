@@ -1,31 +1,97 @@
 // SPDX-License-Identifier: MIT
 // SPDX-FileCopyrightText: 2024 Chris Roberts
 
+#pragma once
 
+#include "BackgroundSet.h"
+#include "BackgroundStorage.h"
+#include "PhaseTimings.h"
+
+#include <GraphicsDefs.h>
+#include <Point.h>
+#include <Screen.h>
+#include <String.h>
 #include <SupportDefs.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
-class BNode;
 class BMessage;
-class BPoint;
-class BString;
-struct rgb_color;
+
+
+// Wallrus applies edits sent by bgswitch when it is running, see BackgroundManager::AddEditsToMessage()
+static const char* const kWallrusSignature = "application/x-vnd.cpr.wallrus";
+
+
+enum background_field {
+	kEditImage,
+	kEditMode,
+	kEditOffset,
+	kEditOutline,
+	kEditColor,
+	kEditReset
+};
+
+
+// A single change for BackgroundManager::Apply().  Bit N of workspaces selects
+// workspace N, bit 0 being the global default.  Only the value matching field is used.
+struct background_edit {
+	background_edit(background_field editField = kEditImage, uint64 editWorkspaces = 0) :
+		workspaces(editWorkspaces),
+		field(editField),
+		mode(B_BACKGROUND_MODE_SCALED),
+		outline(true),
+		color((rgb_color){0, 0, 0, 255})
+	{
+	}
+
+	uint64 workspaces;
+	background_field field;
+	BString path;
+	int32 mode;
+	BPoint offset;
+	bool outline;
+	rgb_color color;
+};
+
+
+// The settings used by one workspace.  path points into the BackgroundManager and
+// stays valid until its settings are modified or it is deleted.
+struct workspace_info {
+	const char* path;
+	int32 mode;
+	BPoint offset;
+	bool erase;
+	rgb_color color;
+	// no custom settings, the global default is used
+	bool followsDefault;
+};
 
 
 class BackgroundManager {
 public:
-	BackgroundManager(const char* path = nullptr);
+	// the app_server keeps a desktop color for each of them
+	static const int32 kMaxWorkspaces = 32;
+
+	// phases are added to timings if it isn't NULL, it must outlive the manager
+	BackgroundManager(const char* path = nullptr, PhaseTimings* timings = nullptr);
 	virtual ~BackgroundManager();
 
 	status_t InitCheck();
+	// reads the settings and desktop colors again, any unflushed changes are lost
+	status_t Reload();
 
 	status_t ResetWorkspace(int32 workspace);
 
 	status_t GetWorkspaceInfo(int32 workspace, BString& path, int32* mode = nullptr, BPoint* offset = nullptr, bool* erase = nullptr, rgb_color* = nullptr);
+	// fills in workspaces 0 to 32, entry 0 being the global default
+	status_t GetAllWorkspaceInfo(workspace_info info[33]);
 
 	status_t SetBackground(const char* imagePath, int32 workspace);
 
 	status_t PrintBackgroundToStream(int32 workspace, bool verbose = false);
+	static status_t PrintBackgroundToStream(int32 workspace, const workspace_info& info, bool verbose = false);
 
 	status_t SetPlacement(int32 mode, int32 workspace);
 
@@ -34,22 +100,71 @@ public:
 	status_t SetOffset(int32 x, int32 y, int32 workspace);
 
 	status_t SetColor(rgb_color color, int32 workspace);
+	// the desktop colors are read again on next use, unless changes are waiting for Flush()
+	void InvalidateDesktopColors();
+
+	status_t Compact(int32* _merged = nullptr);
+	// _changedWorkspaces uses the background_edit layout, bit 0 is the global default
+	status_t Flush(uint64* _changedWorkspaces = nullptr);
+
+	status_t Begin();
+	status_t Apply(const background_edit* edits, int32 count);
+	status_t Commit(uint64* _changedWorkspaces = nullptr);
+
+	// A snapshot holds the stored settings as is plus the desktop colors, importing one
+	// writes the attribute once and notifies Tracker once.
+	status_t ExportSnapshot(std::vector<char>& snapshot);
+	status_t ImportSnapshot(const void* data, size_t size);
 
-	status_t Flush();
+	// stores the edits in a message so another app can Apply() them
+	static status_t AddEditsToMessage(const background_edit* edits, int32 count, BMessage* message);
+	static status_t GetEditsFromMessage(const BMessage* message, std::vector<background_edit>& edits);
 
 	void PrintToStream();
 
 private:
-	int32 _CreateWorkspaceIndex(int32 workspace);
+	int32 _FindWorkspaceIndex(int32 workspace, bool create = false);
 
-	status_t _RemoveWorkspaceIndex(int32 workspace);
+	status_t _ResolvePath(const char* imagePath, BString& resolvedPath);
 
-	int32 _FindWorkspaceIndex(int32 workspace, bool create = false);
+	void _MarkDirty(int32 workspace);
+	status_t _SetImage(const char* resolvedPath, int32 workspace);
+	status_t _SetMode(int32 mode, int32 workspace);
+	status_t _SetOutline(bool enabled, int32 workspace);
+	status_t _SetOffset(BPoint offset, int32 workspace);
+
+	status_t _Load();
+
+	status_t _WriteMessage(bool* _written);
+	status_t _NotifyTracker();
+
+	BScreen* _Screen();
+	status_t _LoadDesktopColors();
+	void _WriteDesktopColors();
 
-	status_t _WriteMessage();
+	BMessage* _Message();
 
+	char* fFlatBuffer;
+	ssize_t fFlatSize;
+	uint64 fFlatHash;
 	BMessage* fBackgroundMessage;
-	BNode* fFolderNode;
+	BackgroundSet fBackgroundSet;
+	// copy of fBackgroundSet from Begin(), restored if Apply() fails
+	BackgroundSet* fTransactionSet;
+	uint64 fTransactionDirty;
+	rgb_color fTransactionColors[kMaxWorkspaces];
+	bool fTransactionColorsLoaded;
+	uint32 fTransactionDirtyColors;
+	BackgroundStorage* fStorage;
 	status_t fInitStatus;
-	bool fDirtyMessage;
+	// workspaces with modified settings, same layout as background_edit::workspaces
+	uint64 fDirtyWorkspaces;
+	BScreen* fScreen;
+	// all desktop colors are read on first use, changes are only sent to the screen by Flush()
+	rgb_color fDesktopColors[kMaxWorkspaces];
+	bool fDesktopColorsLoaded;
+	uint32 fDirtyColors;
+	PhaseTimings* fTimings;
+	// image path as given mapped to the checked absolute path, emptied when a transaction ends
+	std::unordered_map<std::string, std::string> fPathCache;
 };
@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+
+#include "BackgroundSet.h"
+
+#include <iostream>
+
+
+static const int32 kDefaultMode = B_BACKGROUND_MODE_SCALED;
+static const background_origin kDefaultOrigin = {0, 0};
+static const bool kDefaultErase = true;
+
+
+BackgroundSet::BackgroundSet() :
+	fCount(0)
+{
+	MakeEmpty();
+}
+
+
+status_t
+BackgroundSet::SetTo(const BackgroundInfoReader& reader)
+{
+	if (reader.InitCheck() != B_OK)
+		return reader.InitCheck();
+
+	int32 count = reader.Workspaces().CountItems();
+	if (count == 0) {
+		MakeEmpty();
+		return B_OK;
+	}
+
+	fCount = 0;
+	// workspaces already taken by an earlier index, the first index with a workspace wins
+	uint32 claimed = 0;
+	int32 dropped = 0;
+	for (int32 x = 0; x < count; x++) {
+		uint32 workspaces = reader.Workspaces().ItemAt(x);
+		if (x > 0) {
+			// skip stale entries which are not used by any workspace, index 0 must always stay
+			if (workspaces == 0)
+				continue;
+
+			// every workspace ends up in one index at most, so there is always room for them
+			uint32 unclaimed = workspaces & ~claimed;
+			if (unclaimed == 0 || fCount == kMaxIndices) {
+				dropped++;
+				continue;
+			}
+			workspaces = unclaimed;
+			claimed |= workspaces;
+		}
+
+		std::string_view path = reader.Images().ItemAt(x);
+		fWorkspaces[fCount] = workspaces;
+		fPaths[fCount].assign(path.data(), path.length());
+		fModes[fCount] = reader.Modes().ItemAt(x, kDefaultMode);
+		fOrigins[fCount] = reader.Origins().ItemAt(x, kDefaultOrigin);
+		fErase[fCount] = reader.EraseText().ItemAt(x, kDefaultErase);
+		fSetFlags[fCount] = reader.SetFlags().ItemAt(x, 0);
+		fCount++;
+	}
+
+	if (dropped > 0) {
+		std::cerr << "Warning: ignoring " << dropped
+			<< " background entries for workspaces which already have settings" << std::endl;
+	}
+
+	_BuildWorkspaceIndex();
+
+	return B_OK;
+}
+
+
+void
+BackgroundSet::MakeEmpty()
+{
+	// a single global default which all workspaces follow
+	fWorkspaces[0] = 0xffffffff;
+	fPaths[0].clear();
+	fModes[0] = kDefaultMode;
+	fOrigins[0] = kDefaultOrigin;
+	fErase[0] = kDefaultErase;
+	fSetFlags[0] = 0;
+	fCount = 1;
+
+	_BuildWorkspaceIndex();
+}
+
+
+int32
+BackgroundSet::IndexFor(int32 workspace) const
+{
+	if (workspace < 0 || workspace > 32)
+		return B_BAD_VALUE;
+
+	return fWorkspaceIndex[workspace];
+}
+
+
+int32
+BackgroundSet::CreateIndex(int32 workspace)
+{
+	// start at 1 because we don't allow creating workspace 0
+	if (workspace < 1 || workspace > 32)
+		return B_BAD_VALUE;
+
+	if (fCount == kMaxIndices)
+		return B_NO_MEMORY;
+
+	uint32 workspaceBit = 1u << (workspace - 1);
+
+	// tell Tracker that this workspace has a custom background
+	fWorkspaces[0] &= ~workspaceBit;
+
+	// get our default values from index 0
+	int32 index = fCount++;
+	fWorkspaces[index] = workspaceBit;
+	fPaths[index] = fPaths[0];
+	fModes[index] = fModes[0];
+	fOrigins[index] = fOrigins[0];
+	fErase[index] = fErase[0];
+	fSetFlags[index] = 0;
+
+	fWorkspaceIndex[workspace] = index;
+
+	return index;
+}
+
+
+int32
+BackgroundSet::DetachIndex(int32 workspace)
+{
+	if (workspace < 1 || workspace > 32)
+		return B_BAD_VALUE;
+
+	int32 shared = fWorkspaceIndex[workspace];
+	if (shared < 1)
+		return B_BAD_INDEX;
+
+	uint32 workspaceBit = 1u << (workspace - 1);
+
+	// already the only user of this index
+	if (fWorkspaces[shared] == workspaceBit)
+		return shared;
+
+	if (fCount == kMaxIndices)
+		return B_NO_MEMORY;
+
+	// give the workspace its own copy so changes don't leak to the others
+	fWorkspaces[shared] &= ~workspaceBit;
+
+	int32 index = fCount++;
+	fWorkspaces[index] = workspaceBit;
+	fPaths[index] = fPaths[shared];
+	fModes[index] = fModes[shared];
+	fOrigins[index] = fOrigins[shared];
+	fErase[index] = fErase[shared];
+	fSetFlags[index] = fSetFlags[shared];
+
+	fWorkspaceIndex[workspace] = index;
+
+	return index;
+}
+
+
+status_t
+BackgroundSet::RemoveWorkspace(int32 workspace)
+{
+	// we don't allow removing workspace 0
+	if (workspace < 1 || workspace > 32)
+		return B_BAD_VALUE;
+
+	int32 index = fWorkspaceIndex[workspace];
+	if (index < 1)
+		return B_BAD_INDEX;
+
+	uint32 workspaceBit = 1u << (workspace - 1);
+
+	// clear the bit for this workspace, the index goes away if nobody else is using it
+	fWorkspaces[index] &= ~workspaceBit;
+	if (fWorkspaces[index] == 0)
+		_RemoveIndex(index);
+
+	// tell Tracker that this workspace uses the global background
+	fWorkspaces[0] |= workspaceBit;
+	fWorkspaceIndex[workspace] = -1;
+
+	return B_OK;
+}
+
+
+status_t
+BackgroundSet::SetPathAt(int32 index, const char* path)
+{
+	if (index < 0 || index >= fCount)
+		return B_BAD_INDEX;
+
+	if (path == nullptr)
+		fPaths[index].clear();
+	else
+		fPaths[index] = path;
+
+	return B_OK;
+}
+
+
+status_t
+BackgroundSet::SetModeAt(int32 index, int32 mode)
+{
+	if (index < 0 || index >= fCount)
+		return B_BAD_INDEX;
+
+	fModes[index] = mode;
+
+	return B_OK;
+}
+
+
+status_t
+BackgroundSet::SetOriginAt(int32 index, background_origin origin)
+{
+	if (index < 0 || index >= fCount)
+		return B_BAD_INDEX;
+
+	fOrigins[index] = origin;
+
+	return B_OK;
+}
+
+
+status_t
+BackgroundSet::SetEraseAt(int32 index, bool erase)
+{
+	if (index < 0 || index >= fCount)
+		return B_BAD_INDEX;
+
+	fErase[index] = erase;
+
+	return B_OK;
+}
+
+
+int32
+BackgroundSet::Compact()
+{
+	int32 removed = 0;
+
+	// index 0 is left alone, merging into it would turn custom workspaces into ones following the default
+	for (int32 x = 1; x < fCount; x++) {
+		for (int32 y = x + 1; y < fCount; y++) {
+			if (!_IndicesMatch(x, y))
+				continue;
+
+			fWorkspaces[x] |= fWorkspaces[y];
+			_RemoveIndex(y);
+			removed++;
+			y--;
+		}
+	}
+
+	if (removed > 0)
+		_BuildWorkspaceIndex();
+
+	return removed;
+}
+
+
+bool
+BackgroundSet::_IndicesMatch(int32 first, int32 second) const
+{
+	return fPaths[first] == fPaths[second]
+		&& fModes[first] == fModes[second]
+		&& fOrigins[first].x == fOrigins[second].x
+		&& fOrigins[first].y == fOrigins[second].y
+		&& fErase[first] == fErase[second];
+}
+
+
+void
+BackgroundSet::_RemoveIndex(int32 index)
+{
+	fCount--;
+	for (int32 x = index; x < fCount; x++) {
+		fWorkspaces[x] = fWorkspaces[x + 1];
+		fPaths[x].swap(fPaths[x + 1]);
+		fModes[x] = fModes[x + 1];
+		fOrigins[x] = fOrigins[x + 1];
+		fErase[x] = fErase[x + 1];
+		fSetFlags[x] = fSetFlags[x + 1];
+	}
+	fPaths[fCount].clear();
+
+	// every index after the removed one has moved down by one
+	for (int32 x = 1; x <= 32; x++) {
+		if (fWorkspaceIndex[x] > index)
+			fWorkspaceIndex[x]--;
+	}
+}
+
+
+void
+BackgroundSet::_BuildWorkspaceIndex()
+{
+	fWorkspaceIndex[0] = 0;
+	for (int32 x = 1; x <= 32; x++)
+		fWorkspaceIndex[x] = -1;
+
+	// start at 1, index 0 holds the workspaces which follow the global default
+	for (int32 x = 1; x < fCount; x++) {
+		for (int32 bit = 0; bit < 32; bit++) {
+			// the first index with our workspace bit set wins
+			if ((fWorkspaces[x] & (1u << bit)) != 0 && fWorkspaceIndex[bit + 1] < 0)
+				fWorkspaceIndex[bit + 1] = x;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+#include "BackgroundInfoReader.h"
+
+#include <string>
+
+
+// In memory copy of the B_BACKGROUND_INFO message, one entry per message index.
+// Index 0 holds the global default and the bitmask of workspaces following it.
+class BackgroundSet {
+public:
+	// the global default plus one index per workspace
+	static const int32 kMaxIndices = 33;
+
+	BackgroundSet();
+
+	status_t SetTo(const BackgroundInfoReader& reader);
+	void MakeEmpty();
+
+	int32 CountIndices() const { return fCount; }
+
+	// returns 0 for workspace 0 and -1 for workspaces following the global default
+	int32 IndexFor(int32 workspace) const;
+
+	int32 CreateIndex(int32 workspace);
+	int32 DetachIndex(int32 workspace);
+	status_t RemoveWorkspace(int32 workspace);
+
+	int32 Compact();
+
+	uint32 WorkspacesAt(int32 index) const { return fWorkspaces[index]; }
+	const std::string& PathAt(int32 index) const { return fPaths[index]; }
+	int32 ModeAt(int32 index) const { return fModes[index]; }
+	background_origin OriginAt(int32 index) const { return fOrigins[index]; }
+	bool EraseAt(int32 index) const { return fErase[index]; }
+	int32 SetFlagAt(int32 index) const { return fSetFlags[index]; }
+
+	status_t SetPathAt(int32 index, const char* path);
+	status_t SetModeAt(int32 index, int32 mode);
+	status_t SetOriginAt(int32 index, background_origin origin);
+	status_t SetEraseAt(int32 index, bool erase);
+
+private:
+	bool _IndicesMatch(int32 first, int32 second) const;
+	void _RemoveIndex(int32 index);
+	void _BuildWorkspaceIndex();
+
+	uint32 fWorkspaces[kMaxIndices];
+	std::string fPaths[kMaxIndices];
+	int32 fModes[kMaxIndices];
+	background_origin fOrigins[kMaxIndices];
+	bool fErase[kMaxIndices];
+	int32 fSetFlags[kMaxIndices];
+	int32 fCount;
+
+	// message index for each workspace, -1 when following the global default
+	int32 fWorkspaceIndex[33];
+};
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+
+#include "BackgroundStorage.h"
+
+#include <be_apps/Tracker/Background.h>
+#include <kernel/fs_attr.h>
+
+
+NodeBackgroundStorage::NodeBackgroundStorage(const char* path) :
+	fNode(path)
+{
+}
+
+
+status_t
+NodeBackgroundStorage::InitCheck() const
+{
+	return fNode.InitCheck();
+}
+
+
+ssize_t
+NodeBackgroundStorage::Size()
+{
+	attr_info info;
+	if (fNode.GetAttrInfo(B_BACKGROUND_INFO, &info) != B_OK)
+		return B_ENTRY_NOT_FOUND;
+
+	return info.size;
+}
+
+
+ssize_t
+NodeBackgroundStorage::Read(void* buffer, size_t size)
+{
+	return fNode.ReadAttr(B_BACKGROUND_INFO, B_MESSAGE_TYPE, 0, buffer, size);
+}
+
+
+ssize_t
+NodeBackgroundStorage::Write(const void* buffer, size_t size)
+{
+	return fNode.WriteAttr(B_BACKGROUND_INFO, B_MESSAGE_TYPE, 0, buffer, size);
+}
+
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+#include <Node.h>
+
+
+// Where the flattened B_BACKGROUND_INFO message is read from and written to.
+class BackgroundStorage {
+public:
+	virtual ~BackgroundStorage() {}
+
+	virtual status_t InitCheck() const = 0;
+
+	// returns B_ENTRY_NOT_FOUND if no background info has been stored yet
+	virtual ssize_t Size() = 0;
+	virtual ssize_t Read(void* buffer, size_t size) = 0;
+	virtual ssize_t Write(const void* buffer, size_t size) = 0;
+};
+
+
+// The B_BACKGROUND_INFO attribute of a folder, normally the Desktop.
+class NodeBackgroundStorage : public BackgroundStorage {
+public:
+	NodeBackgroundStorage(const char* path);
+
+	virtual status_t InitCheck() const;
+
+	virtual ssize_t Size();
+	virtual ssize_t Read(void* buffer, size_t size);
+	virtual ssize_t Write(const void* buffer, size_t size);
+
+private:
+	BNode fNode;
+};
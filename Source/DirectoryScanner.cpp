@@ -0,0 +1,510 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+
+#include "DirectoryScanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <thread>
+
+
+enum entry_type {
+	kEntryUnknown,
+	kEntryFile,
+	kEntryDirectory,
+	kEntryOther
+};
+
+
+static const char kIndexMagic[4] = {'W', 'R', 'S', 'I'};
+static const uint32 kIndexVersion = 1;
+
+
+// the type stored in the folder itself, only some platforms and file systems provide it
+static inline entry_type
+_entry_type(const struct dirent* entry)
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+	switch (entry->d_type) {
+		case DT_UNKNOWN:
+		case DT_LNK:
+			return kEntryUnknown;
+		case DT_REG:
+			return kEntryFile;
+		case DT_DIR:
+			return kEntryDirectory;
+		default:
+			return kEntryOther;
+	}
+#else
+	(void)entry;
+	return kEntryUnknown;
+#endif
+}
+
+
+// the index is stored little endian no matter what the host uses
+static void
+_write_uint32(std::ostream& output, uint32 value)
+{
+	char bytes[4];
+	for (int32 x = 0; x < 4; x++)
+		bytes[x] = (value >> (x * 8)) & 0xff;
+	output.write(bytes, sizeof(bytes));
+}
+
+
+static void
+_write_uint64(std::ostream& output, uint64 value)
+{
+	_write_uint32(output, value & 0xffffffff);
+	_write_uint32(output, value >> 32);
+}
+
+
+static void
+_write_string(std::ostream& output, const std::string& value)
+{
+	_write_uint32(output, value.length());
+	output.write(value.data(), value.length());
+}
+
+
+static bool
+_read_uint32(std::istream& input, uint32& value)
+{
+	unsigned char bytes[4];
+	if (!input.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+		return false;
+
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32)bytes[3] << 24);
+	return true;
+}
+
+
+static bool
+_read_uint64(std::istream& input, uint64& value)
+{
+	uint32 low;
+	uint32 high;
+	if (!_read_uint32(input, low) || !_read_uint32(input, high))
+		return false;
+
+	value = low | ((uint64)high << 32);
+	return true;
+}
+
+
+static bool
+_read_string(std::istream& input, std::string& value)
+{
+	uint32 length;
+	// nothing in the index comes close, don't allocate gigabytes for a damaged file
+	if (!_read_uint32(input, length) || length > 65536)
+		return false;
+
+	value.resize(length);
+	return (bool)input.read(value.data(), length);
+}
+
+
+static bool
+_read_names(std::istream& input, std::vector<std::string>& names)
+{
+	uint32 count;
+	if (!_read_uint32(input, count))
+		return false;
+
+	names.clear();
+	for (uint32 x = 0; x < count; x++) {
+		std::string name;
+		if (!_read_string(input, name))
+			return false;
+		names.push_back(std::move(name));
+	}
+
+	return true;
+}
+
+
+DirectoryScanner::DirectoryScanner(int32 threadCount) :
+	fThreadCount(threadCount),
+	fUseEntryTypes(true),
+	fQueued(0),
+	fPending(0),
+	fDirectoryCount(0),
+	fIndexedCount(0)
+{
+	if (fThreadCount <= 0)
+		fThreadCount = std::thread::hardware_concurrency();
+	if (fThreadCount <= 0)
+		fThreadCount = 1;
+	else if (fThreadCount > kMaxThreads)
+		fThreadCount = kMaxThreads;
+}
+
+
+status_t
+DirectoryScanner::Scan(const std::vector<std::string>& roots, std::vector<std::string>& files,
+	std::vector<std::string>* directories)
+{
+	fWorkers.clear();
+	for (int32 x = 0; x < fThreadCount; x++)
+		fWorkers.push_back(std::make_unique<worker>());
+
+	fVisited.clear();
+	fQueued = 0;
+	fPending = 0;
+	fDirectoryCount = 0;
+	fIndexedCount = 0;
+
+	// spread the roots over the workers so each one starts with something to do
+	int32 rootCount = 0;
+	for (const std::string& root : roots) {
+		scan_task task;
+		if (stat(root.c_str(), &task.info) != 0 || !S_ISDIR(task.info.st_mode))
+			continue;
+
+		// the same folder configured twice
+		if (!_FirstVisit(task.info))
+			continue;
+
+		task.path = root;
+		_AddTask(rootCount++ % fThreadCount, std::move(task));
+	}
+
+	if (rootCount == 0)
+		return B_ENTRY_NOT_FOUND;
+
+	// the calling thread is the first worker, the queues of threads which fail to start get stolen
+	std::vector<std::thread> threads;
+	for (int32 x = 1; x < fThreadCount; x++) {
+		try {
+			threads.emplace_back(&DirectoryScanner::_Work, this, x);
+		} catch (const std::system_error&) {
+			break;
+		}
+	}
+
+	_Work(0);
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	size_t firstFile = files.size();
+	for (std::unique_ptr<worker>& scanWorker : fWorkers) {
+		files.insert(files.end(), std::make_move_iterator(scanWorker->files.begin()),
+			std::make_move_iterator(scanWorker->files.end()));
+
+		if (directories != nullptr) {
+			directories->insert(directories->end(), std::make_move_iterator(scanWorker->directories.begin()),
+				std::make_move_iterator(scanWorker->directories.end()));
+		}
+
+		for (std::pair<std::string, index_entry>& scanned : scanWorker->scanned)
+			fIndex.insert_or_assign(std::move(scanned.first), std::move(scanned.second));
+
+		for (const std::string& path : scanWorker->reused)
+			fIndex[path].used = true;
+	}
+	std::sort(files.begin() + firstFile, files.end());
+
+	fWorkers.clear();
+	fVisited.clear();
+
+	return B_OK;
+}
+
+
+status_t
+DirectoryScanner::LoadIndex(const char* path)
+{
+	fIndex.clear();
+
+	std::ifstream input(path, std::ios::binary);
+	if (!input.is_open())
+		return B_ENTRY_NOT_FOUND;
+
+	char magic[sizeof(kIndexMagic)];
+	uint32 version;
+	uint32 count;
+	if (!input.read(magic, sizeof(magic)) || memcmp(magic, kIndexMagic, sizeof(magic)) != 0
+		|| !_read_uint32(input, version) || version != kIndexVersion
+		|| !_read_uint32(input, count))
+		return B_BAD_DATA;
+
+	for (uint32 x = 0; x < count; x++) {
+		std::string directoryPath;
+		index_entry entry;
+		uint64 device;
+		uint64 node;
+		uint64 seconds;
+		uint32 nanoseconds;
+		if (!_read_string(input, directoryPath) || !_read_uint64(input, device) || !_read_uint64(input, node)
+			|| !_read_uint64(input, seconds) || !_read_uint32(input, nanoseconds)
+			|| !_read_names(input, entry.files) || !_read_names(input, entry.directories)) {
+			fIndex.clear();
+			return B_BAD_DATA;
+		}
+
+		entry.device = device;
+		entry.node = node;
+		entry.modifiedSeconds = seconds;
+		entry.modifiedNanoseconds = nanoseconds;
+		entry.used = false;
+		fIndex.insert_or_assign(std::move(directoryPath), std::move(entry));
+	}
+
+	return B_OK;
+}
+
+
+status_t
+DirectoryScanner::SaveIndex(const char* path)
+{
+	// written next to the old index and moved over it, a crash never leaves half a file behind
+	std::string tempPath = std::string(path) + ".tmp";
+	std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+		return B_ERROR;
+
+	// folders no Scan() has seen since the last save are no longer below any root
+	std::erase_if(fIndex, [](const std::pair<const std::string, index_entry>& indexed) {
+		return !indexed.second.used;
+	});
+
+	output.write(kIndexMagic, sizeof(kIndexMagic));
+	_write_uint32(output, kIndexVersion);
+	_write_uint32(output, fIndex.size());
+
+	for (std::pair<const std::string, index_entry>& indexed : fIndex) {
+		index_entry& entry = indexed.second;
+		// the next save only keeps what the scans until then see again
+		entry.used = false;
+
+		_write_string(output, indexed.first);
+		_write_uint64(output, entry.device);
+		_write_uint64(output, entry.node);
+		_write_uint64(output, entry.modifiedSeconds);
+		_write_uint32(output, entry.modifiedNanoseconds);
+
+		_write_uint32(output, entry.files.size());
+		for (const std::string& name : entry.files)
+			_write_string(output, name);
+
+		_write_uint32(output, entry.directories.size());
+		for (const std::string& name : entry.directories)
+			_write_string(output, name);
+	}
+
+	output.close();
+	if (!output || rename(tempPath.c_str(), path) != 0) {
+		remove(tempPath.c_str());
+		return B_IO_ERROR;
+	}
+
+	return B_OK;
+}
+
+
+void
+DirectoryScanner::_Work(int32 index)
+{
+	scan_task task;
+	while (true) {
+		if (_NextTask(index, task)) {
+			_ScanDirectory(index, task);
+
+			if (--fPending == 0) {
+				std::lock_guard<std::mutex> idleLock(fIdleLock);
+				fIdleCondition.notify_all();
+			}
+			continue;
+		}
+
+		// sleep until another thread adds a task or the last one is finished
+		std::unique_lock<std::mutex> idleLock(fIdleLock);
+		if (fPending == 0)
+			return;
+
+		fIdleCondition.wait(idleLock, [this]() { return fPending == 0 || fQueued > 0; });
+	}
+}
+
+
+bool
+DirectoryScanner::_NextTask(int32 index, scan_task& task)
+{
+	// newest first from our own queue, its folders are likely still cached
+	{
+		worker& own = *fWorkers[index];
+		std::lock_guard<std::mutex> lock(own.lock);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			fQueued--;
+			return true;
+		}
+	}
+
+	// steal the oldest task of another worker, those tend to be the largest subtrees
+	for (int32 offset = 1; offset < fThreadCount; offset++) {
+		worker& victim = *fWorkers[(index + offset) % fThreadCount];
+		std::lock_guard<std::mutex> lock(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			fQueued--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void
+DirectoryScanner::_AddTask(int32 index, scan_task&& task)
+{
+	// counted before it can be taken so fPending never reaches 0 early
+	fPending++;
+
+	{
+		worker& own = *fWorkers[index];
+		std::lock_guard<std::mutex> lock(own.lock);
+		own.tasks.push_back(std::move(task));
+	}
+
+	std::lock_guard<std::mutex> idleLock(fIdleLock);
+	fQueued++;
+	fIdleCondition.notify_one();
+}
+
+
+void
+DirectoryScanner::_ScanDirectory(int32 index, const scan_task& task)
+{
+	worker& own = *fWorkers[index];
+
+	// adding or removing an entry changes the modification time, the listing can be reused
+	std::unordered_map<std::string, index_entry>::const_iterator indexed = fIndex.find(task.path);
+	if (indexed != fIndex.end() && _IndexMatches(indexed->second, task.info)) {
+		fIndexedCount++;
+
+		for (const std::string& name : indexed->second.files)
+			own.files.push_back(ChildPath(task.path, name.c_str()));
+		for (const std::string& name : indexed->second.directories)
+			_AddDirectory(index, task.path, name.c_str());
+
+		own.directories.push_back(task.path);
+		own.reused.push_back(task.path);
+		return;
+	}
+
+	DIR* dir = opendir(task.path.c_str());
+	if (dir == nullptr)
+		return;
+
+	fDirectoryCount++;
+
+	index_entry entry;
+	entry.device = task.info.st_dev;
+	entry.node = task.info.st_ino;
+	entry.modifiedSeconds = task.info.st_mtim.tv_sec;
+	entry.modifiedNanoseconds = task.info.st_mtim.tv_nsec;
+	entry.used = true;
+
+	// entries are looked up relative to the open folder instead of walking the whole path again
+	int dirFd = dirfd(dir);
+
+	struct dirent* dirEntry;
+	while ((dirEntry = readdir(dir)) != nullptr) {
+		const char* name = dirEntry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		// most entries are plain files, when the file system reports the type they need no stat()
+		entry_type type = fUseEntryTypes ? _entry_type(dirEntry) : kEntryUnknown;
+		if (type == kEntryOther || (type == kEntryFile && name[0] == '.'))
+			continue;
+
+		if (type == kEntryFile) {
+			entry.files.push_back(name);
+			own.files.push_back(ChildPath(task.path, name));
+			continue;
+		}
+
+		// fstatat() follows symbolic links the same as BEntry(path, true)
+		struct stat childStat;
+		if (fstatat(dirFd, name, &childStat, 0) != 0)
+			continue;
+
+		if (S_ISDIR(childStat.st_mode)) {
+			entry.directories.push_back(name);
+			if (_FirstVisit(childStat)) {
+				scan_task childTask;
+				childTask.path = ChildPath(task.path, name);
+				childTask.info = childStat;
+				_AddTask(index, std::move(childTask));
+			}
+		} else if (S_ISREG(childStat.st_mode) && name[0] != '.') {
+			entry.files.push_back(name);
+			own.files.push_back(ChildPath(task.path, name));
+		}
+	}
+
+	closedir(dir);
+
+	own.directories.push_back(task.path);
+	own.scanned.emplace_back(task.path, std::move(entry));
+}
+
+
+void
+DirectoryScanner::_AddDirectory(int32 index, const std::string& path, const char* name)
+{
+	// the folder itself may have changed, its own modification time is checked by its task
+	scan_task task;
+	task.path = ChildPath(path, name);
+	if (stat(task.path.c_str(), &task.info) != 0 || !S_ISDIR(task.info.st_mode))
+		return;
+
+	if (_FirstVisit(task.info))
+		_AddTask(index, std::move(task));
+}
+
+
+bool
+DirectoryScanner::_FirstVisit(const struct stat& info)
+{
+	std::lock_guard<std::mutex> lock(fVisitedLock);
+	return fVisited.emplace(info.st_dev, info.st_ino).second;
+}
+
+
+std::string
+DirectoryScanner::ChildPath(const std::string& path, const char* name)
+{
+	std::string childPath = path;
+	if (childPath.back() != '/')
+		childPath += '/';
+	childPath += name;
+
+	return childPath;
+}
+
+
+bool
+DirectoryScanner::_IndexMatches(const index_entry& entry, const struct stat& info)
+{
+	return entry.device == info.st_dev && entry.node == info.st_ino
+		&& entry.modifiedSeconds == info.st_mtim.tv_sec
+		&& entry.modifiedNanoseconds == info.st_mtim.tv_nsec;
+}
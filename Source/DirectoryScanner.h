@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+#include "PortableDefs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// Recursively lists the files below a set of folders with a bounded pool of threads.
+// Every folder is a task, each thread works through its own queue and steals from
+// the others when it runs out, so a single deep tree still keeps all of them busy.
+//
+// The contents of each folder are remembered in an index which can be saved to disk.
+// Folders with the same node and modification time as in the index are not read again.
+class DirectoryScanner {
+public:
+	static const int32 kMaxThreads = 8;
+
+	// 0 uses one thread per CPU, up to kMaxThreads
+	DirectoryScanner(int32 threadCount = 0);
+
+	int32 CountThreads() const { return fThreadCount; }
+
+	// When false every entry is checked with stat(), even where readdir() reports its type.
+	// That is what always happens on Haiku, which has no d_type.
+	void SetUseEntryTypes(bool use) { fUseEntryTypes = use; }
+
+	// Symbolic links are followed and files starting with a dot are skipped.  The files
+	// are appended sorted, B_ENTRY_NOT_FOUND is returned if none of the roots are folders.
+	// The folders which were listed, including the roots, are appended to directories.
+	status_t Scan(const std::vector<std::string>& roots, std::vector<std::string>& files,
+		std::vector<std::string>* directories = nullptr);
+	// how the paths passed to Scan() are joined with the names found below them
+	static std::string ChildPath(const std::string& path, const char* name);
+
+	// folders read from disk and folders taken from the index by the last Scan()
+	int32 CountDirectories() const { return fDirectoryCount; }
+	int32 CountIndexedDirectories() const { return fIndexedCount; }
+
+	// replaces the index, it is left empty if the file is missing or invalid
+	status_t LoadIndex(const char* path);
+	// only folders seen by a Scan() since the index was loaded or last saved are kept
+	status_t SaveIndex(const char* path);
+	int32 CountIndexEntries() const { return fIndex.size(); }
+
+private:
+	struct scan_task {
+		std::string path;
+		struct stat info;
+	};
+
+	struct index_entry {
+		dev_t device;
+		ino_t node;
+		int64 modifiedSeconds;
+		int32 modifiedNanoseconds;
+		// names of the files to list and of the folders to descend into
+		std::vector<std::string> files;
+		std::vector<std::string> directories;
+		bool used;
+	};
+
+	struct worker {
+		std::mutex lock;
+		std::deque<scan_task> tasks;
+		// the rest is only touched by the thread owning the worker
+		std::vector<std::string> files;
+		std::vector<std::string> directories;
+		std::vector<std::pair<std::string, index_entry>> scanned;
+		std::vector<std::string> reused;
+	};
+
+	void _Work(int32 index);
+	bool _NextTask(int32 index, scan_task& task);
+	void _AddTask(int32 index, scan_task&& task);
+	void _ScanDirectory(int32 index, const scan_task& task);
+	void _AddDirectory(int32 index, const std::string& path, const char* name);
+	bool _FirstVisit(const struct stat& info);
+
+	static bool _IndexMatches(const index_entry& entry, const struct stat& info);
+
+	int32 fThreadCount;
+	bool fUseEntryTypes;
+	std::vector<std::unique_ptr<worker>> fWorkers;
+	// tasks waiting in a queue, and those plus the ones being worked on
+	std::atomic<int32> fQueued;
+	std::atomic<int32> fPending;
+	std::atomic<int32> fDirectoryCount;
+	std::atomic<int32> fIndexedCount;
+	std::mutex fIdleLock;
+	std::condition_variable fIdleCondition;
+	// folders already queued, symbolic links can point back up the tree
+	std::mutex fVisitedLock;
+	std::set<std::pair<dev_t, ino_t>> fVisited;
+	// only read while scanning, updated from the workers once all threads are done
+	std::unordered_map<std::string, index_entry> fIndex;
+};
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+
+#include "PathStore.h"
+
+
+static const uint32 kInitialSlots = 64;
+
+
+PathStore::PathStore()
+{
+	MakeEmpty();
+}
+
+
+uint32
+PathStore::Add(std::string_view path)
+{
+	std::string_view directoryPath;
+	std::string_view name;
+	_Split(path, directoryPath, name);
+
+	uint32 directory;
+	auto found = fDirectoryIds.find(directoryPath);
+	if (found != fDirectoryIds.end())
+		directory = found->second;
+	else {
+		directory = fDirectories.size();
+		fDirectories.emplace_back(directoryPath);
+		fDirectoryIds.emplace(directoryPath, directory);
+	}
+
+	uint32 hash = _Hash(directory, name);
+	uint32 slot = _FindSlot(directory, name, hash);
+	if (fSlots[slot] != kInvalidId)
+		return fSlots[slot];
+
+	// the ids and name offsets have to fit in 32 bits
+	if (fFiles.size() >= kInvalidId - 1 || fNames.size() + name.length() >= kInvalidId)
+		return kInvalidId;
+
+	// keep the table at most three quarters full so the probe sequences stay short
+	if ((fFiles.size() + 1) * 4 > fSlots.size() * 3) {
+		_Grow();
+		slot = _FindSlot(directory, name, hash);
+	}
+
+	file_entry entry;
+	entry.directory = directory;
+	entry.name = fNames.size();
+	fNames.insert(fNames.end(), name.begin(), name.end());
+	fNames.push_back('\0');
+
+	uint32 id = fFiles.size();
+	fFiles.push_back(entry);
+	fSlots[slot] = id;
+
+	return id;
+}
+
+
+uint32
+PathStore::Find(std::string_view path) const
+{
+	std::string_view directoryPath;
+	std::string_view name;
+	_Split(path, directoryPath, name);
+
+	auto found = fDirectoryIds.find(directoryPath);
+	if (found == fDirectoryIds.end())
+		return kInvalidId;
+
+	return fSlots[_FindSlot(found->second, name, _Hash(found->second, name))];
+}
+
+
+void
+PathStore::FindBelow(std::string_view path, std::vector<uint32>& ids) const
+{
+	uint32 id = Find(path);
+	if (id != kInvalidId)
+		ids.push_back(id);
+
+	// folders are stored with a trailing slash
+	std::string prefix(path);
+	prefix += "/";
+
+	std::vector<bool> below(fDirectories.size(), false);
+	bool anyBelow = false;
+	for (size_t x = 0; x < fDirectories.size(); x++) {
+		if (fDirectories[x].starts_with(prefix)) {
+			below[x] = true;
+			anyBelow = true;
+		}
+	}
+
+	if (!anyBelow)
+		return;
+
+	for (size_t x = 0; x < fFiles.size(); x++) {
+		if (below[fFiles[x].directory])
+			ids.push_back(x);
+	}
+}
+
+
+std::string
+PathStore::PathAt(uint32 id) const
+{
+	if (id >= fFiles.size())
+		return std::string();
+
+	const file_entry& entry = fFiles[id];
+	std::string path(fDirectories[entry.directory]);
+	path += &fNames[entry.name];
+
+	return path;
+}
+
+
+size_t
+PathStore::MemoryUsage() const
+{
+	size_t bytes = fNames.capacity() + fFiles.capacity() * sizeof(file_entry) + fSlots.capacity() * sizeof(uint32)
+		+ fDirectories.capacity() * sizeof(std::string) + fDirectoryIds.bucket_count() * sizeof(void*);
+
+	// each folder path is held by fDirectories and by a node of fDirectoryIds
+	for (const std::string& directory : fDirectories)
+		bytes += directory.capacity() * 2 + sizeof(std::string) + sizeof(uint32) + 2 * sizeof(void*);
+
+	return bytes;
+}
+
+
+void
+PathStore::MakeEmpty()
+{
+	// swap with empty containers so the memory is actually released
+	std::vector<std::string>().swap(fDirectories);
+	decltype(fDirectoryIds)().swap(fDirectoryIds);
+	std::vector<file_entry>().swap(fFiles);
+	std::vector<char>().swap(fNames);
+	std::vector<uint32>(kInitialSlots, kInvalidId).swap(fSlots);
+}
+
+
+void
+PathStore::_Split(std::string_view path, std::string_view& directory, std::string_view& name)
+{
+	// the folder keeps its trailing slash so joining them back is a simple append
+	size_t slash = path.rfind('/');
+	if (slash == std::string_view::npos) {
+		directory = std::string_view();
+		name = path;
+	} else {
+		directory = path.substr(0, slash + 1);
+		name = path.substr(slash + 1);
+	}
+}
+
+
+uint32
+PathStore::_Hash(uint32 directory, std::string_view name)
+{
+	// FNV-1a over the name, starting from the folder id
+	uint32 hash = 2166136261u ^ (directory * 2654435761u);
+	for (char character : name) {
+		hash ^= (uint8)character;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+uint32
+PathStore::_FindSlot(uint32 directory, std::string_view name, uint32 hash) const
+{
+	uint32 mask = fSlots.size() - 1;
+	uint32 slot = hash & mask;
+	while (true) {
+		uint32 id = fSlots[slot];
+		if (id == kInvalidId)
+			return slot;
+
+		const file_entry& entry = fFiles[id];
+		if (entry.directory == directory && name == &fNames[entry.name])
+			return slot;
+
+		slot = (slot + 1) & mask;
+	}
+}
+
+
+void
+PathStore::_Grow()
+{
+	std::vector<uint32>(fSlots.size() * 2, kInvalidId).swap(fSlots);
+
+	for (uint32 id = 0; id < fFiles.size(); id++) {
+		const file_entry& entry = fFiles[id];
+		std::string_view name(&fNames[entry.name]);
+		fSlots[_FindSlot(entry.directory, name, _Hash(entry.directory, name))] = id;
+	}
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+#include "PortableDefs.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// Compact storage for a large number of file paths.  Each folder is stored once and
+// the file names are packed one after another into a single buffer, so a path costs
+// little more than the length of its name.  Paths are addressed by 32 bit ids.
+//
+// Paths are never removed, the ids stay valid until MakeEmpty() is called.
+class PathStore {
+public:
+	static constexpr uint32 kInvalidId = 0xffffffff;
+
+	PathStore();
+
+	// the same path always gets the same id
+	uint32 Add(std::string_view path);
+	uint32 Find(std::string_view path) const;
+	// appends the id of path and the ids of all paths below it
+	void FindBelow(std::string_view path, std::vector<uint32>& ids) const;
+
+	std::string PathAt(uint32 id) const;
+	int32 CountPaths() const { return fFiles.size(); }
+
+	// approximate bytes in use, including unused capacity
+	size_t MemoryUsage() const;
+	void MakeEmpty();
+
+private:
+	struct file_entry {
+		uint32 directory;
+		// offset of the null terminated name in fNames
+		uint32 name;
+	};
+
+	// allows looking up folders without copying them into a std::string
+	struct string_hash {
+		using is_transparent = void;
+		size_t operator()(std::string_view value) const { return std::hash<std::string_view>()(value); }
+	};
+
+	static void _Split(std::string_view path, std::string_view& directory, std::string_view& name);
+	static uint32 _Hash(uint32 directory, std::string_view name);
+	// slot holding the id of the file, or the empty slot where it would go
+	uint32 _FindSlot(uint32 directory, std::string_view name, uint32 hash) const;
+	void _Grow();
+
+	std::vector<std::string> fDirectories;
+	std::unordered_map<std::string, uint32, string_hash, std::equal_to<>> fDirectoryIds;
+	std::vector<file_entry> fFiles;
+	std::vector<char> fNames;
+	// open addressing table of file ids, its size is always a power of two
+	std::vector<uint32> fSlots;
+};
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+
+#include "PhaseTimings.h"
+
+#include <cstring>
+
+
+void
+PhaseTimings::Add(const char* name, bigtime_t duration)
+{
+	for (phase& existing : fPhases) {
+		if (strcmp(existing.name, name) == 0) {
+			existing.duration += duration;
+			return;
+		}
+	}
+
+	fPhases.push_back({name, duration});
+}
+
+
+void
+PhaseTimings::MakeEmpty()
+{
+	fPhases.clear();
+}
+
+
+bigtime_t
+PhaseTimings::TotalDuration() const
+{
+	bigtime_t total = 0;
+	for (const phase& existing : fPhases)
+		total += existing.duration;
+
+	return total;
+}
+
+
+BString
+PhaseTimings::Summary() const
+{
+	BString summary;
+	for (const phase& existing : fPhases) {
+		if (!summary.IsEmpty())
+			summary << ", ";
+		summary << existing.name << ": " << existing.duration << "us";
+	}
+
+	return summary;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+#include <OS.h>
+#include <String.h>
+#include <SupportDefs.h>
+#include <vector>
+
+
+// Adds up how long each named phase of an operation takes, in microseconds.
+// Phases are kept in the order they first ran, repeated phases are summed.
+class PhaseTimings {
+public:
+	void Add(const char* name, bigtime_t duration);
+	void MakeEmpty();
+
+	int32 CountPhases() const { return fPhases.size(); }
+	const char* NameAt(int32 index) const { return fPhases[index].name; }
+	bigtime_t DurationAt(int32 index) const { return fPhases[index].duration; }
+	bigtime_t TotalDuration() const;
+
+	// all phases on a single line, ex. "read: 120us, parse: 15us"
+	BString Summary() const;
+
+private:
+	struct phase {
+		// names are expected to be string literals, they are not copied
+		const char* name;
+		bigtime_t duration;
+	};
+
+	std::vector<phase> fPhases;
+};
+
+
+// Times its own lifetime and adds it to a PhaseTimings, does nothing if that is NULL.
+class PhaseTimer {
+public:
+	PhaseTimer(PhaseTimings* timings, const char* name) :
+		fTimings(timings),
+		fName(name),
+		fStart(timings != nullptr ? system_time() : 0)
+	{
+	}
+
+	~PhaseTimer()
+	{
+		if (fTimings != nullptr)
+			fTimings->Add(fName, system_time() - fStart);
+	}
+
+private:
+	PhaseTimings* fTimings;
+	const char* fName;
+	bigtime_t fStart;
+};
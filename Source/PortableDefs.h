@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+#pragma once
+
+// Minimal subset of the Haiku support types used by the OS independent parts of
+// bgswitch, so they can be compiled and exercised on other platforms.
+
+#ifdef __HAIKU__
+
+#include <SupportDefs.h>
+#include <TypeConstants.h>
+
+#else
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+
+typedef int32 status_t;
+typedef uint32 type_code;
+
+enum {
+	B_OK = 0,
+	B_ERROR = -1,
+	B_NO_MEMORY = INT32_MIN,
+	B_IO_ERROR,
+	B_PERMISSION_DENIED,
+	B_BAD_INDEX,
+	B_BAD_TYPE,
+	B_BAD_VALUE,
+	B_MISMATCHED_VALUES,
+	B_NAME_NOT_FOUND,
+	B_NAME_IN_USE,
+	B_TIMED_OUT,
+	B_INTERRUPTED,
+	B_WOULD_BLOCK,
+	B_CANCELED,
+	B_NO_INIT,
+	B_NOT_INITIALIZED,
+	B_BUSY,
+	B_NOT_ALLOWED,
+	B_BAD_DATA,
+	B_ENTRY_NOT_FOUND,
+	B_NOT_SUPPORTED
+};
+
+// spelled out in hex so other compilers don't warn about multi-character constants
+enum {
+	B_BOOL_TYPE = 0x424f4f4c,	// 'BOOL'
+	B_INT32_TYPE = 0x4c4f4e47,	// 'LONG'
+	B_MESSAGE_TYPE = 0x4d534747,	// 'MSGG'
+	B_POINT_TYPE = 0x42504e54,	// 'BPNT'
+	B_STRING_TYPE = 0x43535452	// 'CSTR'
+};
+
+#endif // __HAIKU__
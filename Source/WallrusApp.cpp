@@ -10,24 +10,51 @@
 #include <MessageRunner.h>
 #include <NodeMonitor.h>
 #include <Path.h>
+#include <private/shared/AutoDeleter.h>
+#include <algorithm>
+#include <iterator>
 #include <experimental/random>
 #include <iomanip>
 #include <iostream>
+#include <sys/resource.h>
+#include <vector>
 
 
 // TODO add scripting commands
 enum {
 	kRotateWhat = 'ROT8',
-	kRunnerWhat = 'MRT8'
+	kRunnerWhat = 'MRT8',
+	kScanDoneWhat = 'SCND',
+	kRescanWhat = 'RSCN'
 };
 
+// folders which can't be node monitored are scanned again this often
+static const bigtime_t kRescanInterval = 5 * 60 * 1000000LL;
+// the number of node monitors a team may use, the default is much lower
+static const rlim_t kNodeMonitorLimit = 65536;
+
 
 WallrusApp::WallrusApp() :
-	BServer("application/x-vnd.cpr.wallrus", true, nullptr),
+	BServer(kWallrusSignature, true, nullptr),
+	fBackgroundManager(nullptr, &fTimings),
 	fRotateTime(-1),
 	fRotateRunner(nullptr),
-	fLogLevel(kLogError)
+	fLogLevel(kLogError),
+	fScanThread(-1),
+	fScanPending(false),
+	fRotatePending(false),
+	fUnwatchedWorkspaces(0),
+	fRescanRunner(nullptr)
 {
+	// every image folder is watched, large libraries easily have more than the default allows
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOVMON, &limit) == 0 && limit.rlim_cur < kNodeMonitorLimit) {
+		limit.rlim_cur = kNodeMonitorLimit;
+		limit.rlim_max = std::max(limit.rlim_max, kNodeMonitorLimit);
+		if (setrlimit(RLIMIT_NOVMON, &limit) != 0)
+			_Log(kLogError, "Unable to raise the node monitor limit");
+	}
+
 	if (_LoadSettings() != B_OK)
 		_Log(kLogError, "Error loading settings!");
 
@@ -35,6 +62,7 @@ WallrusApp::WallrusApp() :
 		_Log(kLogError, "Error intializing background manager!");
 		return;
 	}
+	_Log(kLogDebug, "Load timings: %s", fTimings.Summary().String());
 
 	_Log(kLogTrace, "%s() finished", __FUNCTION__);
 }
@@ -44,6 +72,13 @@ WallrusApp::~WallrusApp()
 {
 	TRACE
 
+	// the scan thread posts its results to the looper, which has quit by now
+	if (fScanThread >= 0) {
+		status_t result;
+		wait_for_thread(fScanThread, &result);
+	}
+
+	delete fRescanRunner;
 	_ResetMaps();
 }
 
@@ -54,8 +89,12 @@ WallrusApp::MessageReceived(BMessage* message)
 	// TODO log messages?
 	switch (message->what) {
 		case B_NODE_MONITOR:
-			if (message->GetInt32("fields", 0) & B_STAT_MODIFICATION_TIME)
-				_LoadSettings();
+			// the settings file is watched for stat changes, the image folders for their entries
+			if (message->GetInt32("opcode", 0) == B_STAT_CHANGED) {
+				if (message->GetInt32("fields", 0) & B_STAT_MODIFICATION_TIME)
+					_LoadSettings();
+			} else
+				_HandleDirectoryEvent(message);
 			break;
 		case kRotateWhat:
 			_ResetMessageRunner();
@@ -63,6 +102,13 @@ WallrusApp::MessageReceived(BMessage* message)
 		case kRunnerWhat:
 			_RotateBackgrounds();
 			break;
+		case kScanDoneWhat:
+			_ScanDone(message);
+			break;
+		case kRescanWhat:
+			if (fUnwatchedWorkspaces != 0)
+				_StartScan(fUnwatchedWorkspaces);
+			break;
 		case B_COUNT_PROPERTIES:
 		case B_EXECUTE_PROPERTY:
 		case B_GET_PROPERTY:
@@ -82,7 +128,10 @@ WallrusApp::ReadyToRun()
 {
 	TRACE
 
-	_RotateBackgrounds();
+	if (fScanThread >= 0)
+		fRotatePending = true;
+	else
+		_RotateBackgrounds();
 }
 
 
@@ -91,17 +140,12 @@ WallrusApp::_ResetMaps()
 {
 	TRACE
 
-	// delete fWorkspaceFileMap/fSettingsFolderMap contents
-	auto iterator = fWorkspaceFileMap.GetIterator();
-	while (iterator.HasNext()) {
-		const auto& entry = iterator.Next();
-		BObjectList<BString>* list = entry.value;
-		list->MakeEmpty();
-		delete list;
-	}
-	fWorkspaceFileMap.Clear();
+	fWorkspaceFileMap.clear();
+	fWorkspaceLibrary.clear();
+	fPaths.MakeEmpty();
 
-	iterator = fSettingsFolderMap.GetIterator();
+	// delete fSettingsFolderMap contents
+	auto iterator = fSettingsFolderMap.GetIterator();
 	while (iterator.HasNext()) {
 		const auto& entry = iterator.Next();
 		BObjectList<BString>* list = entry.value;
@@ -135,61 +179,478 @@ WallrusApp::_RotateBackgrounds()
 {
 	TRACE
 
+	// collect the new wallpapers so they are written to Tracker all at once
+	std::vector<background_edit> edits;
+
 	// iterate through the map and pick a random wallpaper
-	auto iterator = fWorkspaceFileMap.GetIterator();
+	for (auto& entry : fWorkspaceFileMap) {
+		int32 workspace = entry.first;
+		// if list is empty then start over with the whole library
+		std::vector<uint32>& list = entry.second;
+		if (list.empty())
+			if (_RefillRotation(workspace) != B_OK)
+				continue;
+
+		int32 rand = std::experimental::randint(0, static_cast<int>(list.size() - 1));
+		std::string path = fPaths.PathAt(list[rand]);
+		// the order of the round doesn't matter, fill the gap with the last file
+		list[rand] = list.back();
+		list.pop_back();
+
+		// change background, Apply() checks that the file still exists
+		background_edit edit(kEditImage, (uint64)1 << workspace);
+		edit.path = path.c_str();
+		edits.push_back(edit);
+		_Log(kLogInfo, "Workspace %" B_PRIi32 " [%" B_PRIi32 " left] %s", workspace, (int32)list.size(), path.c_str());
+	}
+
+	// a file which disappeared fails all of the edits, don't let it hold up the other workspaces
+	if (_ApplyEdits(edits.data(), edits.size()) != B_OK && edits.size() > 1) {
+		for (const background_edit& edit : edits)
+			_ApplyEdits(&edit, 1);
+	}
+
+	return B_OK;
+}
+
+
+status_t
+WallrusApp::_ApplyEdits(const background_edit* edits, int32 count)
+{
+	TRACEF("..., %" B_PRIi32, count)
+
+	fTimings.MakeEmpty();
+	fBackgroundManager.Begin();
+	status_t status = fBackgroundManager.Apply(edits, count);
+	if (status != B_OK)
+		_Log(kLogError, "Unable to apply new backgrounds");
+
+	// also ends the transaction when Apply() failed, nothing has been changed in that case
+	uint64 changedWorkspaces = 0;
+	if (fBackgroundManager.Commit(&changedWorkspaces) != B_OK && status == B_OK)
+		status = B_ERROR;
+	_Log(kLogDebug, "Changed workspaces: 0x%" B_PRIx64, changedWorkspaces);
+	_Log(kLogDebug, "Timings: %s", fTimings.Summary().String());
+
+	return status;
+}
+
+
+void
+WallrusApp::_StartScan(uint64 rescanWorkspaces)
+{
+	TRACEF("0x%" B_PRIx64, rescanWorkspaces)
+
+	// two scans would write the index at the same time, the folders are scanned again
+	// once the running scan is done.  A rescan waits for the next turn instead.
+	if (fScanThread >= 0) {
+		if (rescanWorkspaces == 0)
+			fScanPending = true;
+		return;
+	}
+
+	scan_job* job = new scan_job;
+	job->target = BMessenger(this);
+	job->indexEntries = 0;
+	job->threadCount = 0;
+	job->indexStatus = B_OK;
+	// the index keeps only the folders seen since it was read, a rescan only sees a few workspaces
+	job->saveIndex = rescanWorkspaces == 0;
+
+	// folders which haven't changed since the last run are listed from the index
+	BPath indexPath;
+	if (_GetScanIndexPath(indexPath) == B_OK)
+		job->indexPath = indexPath.Path();
+
+	auto iterator = fSettingsFolderMap.GetIterator();
 	while (iterator.HasNext()) {
 		const auto& entry = iterator.Next();
-		// if list is empty then rescan
-		BObjectList<BString>* list = entry.value;
-		if (list->CountItems() == 0)
-			if (_RescanDirectories(entry.key.value) != B_OK)
-				continue;
+		BObjectList<BString>* folderList = entry.value;
+		if (folderList->CountItems() == 0
+			|| (rescanWorkspaces != 0 && (rescanWorkspaces & ((uint64)1 << entry.key.value)) == 0))
+			continue;
 
-		int32 rand = std::experimental::randint(0, static_cast<int>(list->CountItems() - 1));
-		BString* bgString = list->ItemAt(rand);
-		// verify file exists
-		if (BEntry(bgString->String()).IsFile()) {
-			// change background
-			fBackgroundManager.SetBackground(bgString->String(), entry.key.value);
-			_Log(kLogInfo, "Workspace %" B_PRIi32 " [%" B_PRIi32 " left] %s", entry.key.value, list->CountItems() - 1, bgString->String());
-		}
-		list->RemoveItemAt(rand);
+		std::vector<std::string>& roots = job->workspaces[entry.key.value].roots;
+		for (int32 x = 0; x < folderList->CountItems(); x++)
+			roots.push_back(folderList->ItemAt(x)->String());
 	}
 
-	fBackgroundManager.Flush();
+	fScanThread = spawn_thread(&_ScanThread, "wallrus scanner", B_LOW_PRIORITY, job);
+	if (fScanThread < 0 || resume_thread(fScanThread) != B_OK) {
+		_Log(kLogError, "Unable to start scanning the image folders");
+		fScanThread = -1;
+		delete job;
+	}
+}
+
+
+status_t
+WallrusApp::_ScanThread(void* data)
+{
+	// nothing of the app is touched here, not even the log, until the looper gets the job back
+	scan_job* job = static_cast<scan_job*>(data);
+
+	// the index is only needed while scanning, it is read again by the next scan instead
+	// of being kept in memory as long as Wallrus runs
+	DirectoryScanner scanner;
+	job->threadCount = scanner.CountThreads();
+	if (!job->indexPath.empty() && scanner.LoadIndex(job->indexPath.c_str()) == B_OK)
+		job->indexEntries = scanner.CountIndexEntries();
+
+	// every folder of a workspace is read at once by the scanner threads
+	for (auto& entry : job->workspaces) {
+		scan_job::workspace_scan& scan = entry.second;
+		bigtime_t startTime = system_time();
+		scan.status = scanner.Scan(scan.roots, scan.files, &scan.directories);
+		scan.time = system_time() - startTime;
+		scan.directoryCount = scanner.CountDirectories();
+		scan.indexedCount = scanner.CountIndexedDirectories();
+	}
+
+	if (job->saveIndex && !job->indexPath.empty())
+		job->indexStatus = scanner.SaveIndex(job->indexPath.c_str());
+
+	BMessage message(kScanDoneWhat);
+	message.AddPointer("job", job);
+	if (job->target.SendMessage(&message) != B_OK)
+		delete job;
 
 	return B_OK;
 }
 
 
+void
+WallrusApp::_ScanDone(BMessage* message)
+{
+	TRACE
+
+	scan_job* job;
+	if (message->FindPointer("job", reinterpret_cast<void**>(&job)) != B_OK)
+		return;
+	ObjectDeleter<scan_job> jobDeleter(job);
+
+	status_t result;
+	wait_for_thread(fScanThread, &result);
+	fScanThread = -1;
+
+	// the settings changed while the folders were scanned, the results are outdated
+	if (fScanPending) {
+		fScanPending = false;
+		_StartScan();
+		return;
+	}
+
+	if (job->indexEntries > 0)
+		_Log(kLogDebug, "Loaded scan index with %" B_PRIi32 " folders", job->indexEntries);
+	if (job->indexStatus != B_OK)
+		_Log(kLogError, "Unable to save scan index");
+
+	for (const auto& entry : job->workspaces) {
+		int32 workspace = entry.first;
+		const scan_job::workspace_scan& scan = entry.second;
+		if (scan.status != B_OK) {
+			_Log(kLogError, "Workspace %" B_PRIi32 " has no folders which could be scanned", workspace);
+			continue;
+		}
+
+		_Log(kLogDebug, "Workspace %" B_PRIi32 " scanned %" B_PRIi32 " folders, %" B_PRIi32 " unchanged, with %"
+			B_PRIi32 " threads in %" B_PRIi64 "us", workspace, scan.directoryCount, scan.indexedCount,
+			job->threadCount, scan.time);
+
+		// from now on the folders report their changes, those which can't be watched because
+		// the node monitor limit was reached are scanned again every few minutes
+		int32 unwatched = 0;
+		for (const std::string& directory : scan.directories) {
+			if (_WatchDirectory(workspace, directory.c_str()) != B_OK)
+				unwatched++;
+		}
+
+		uint64 workspaceBit = (uint64)1 << workspace;
+		if (unwatched > 0) {
+			if ((fUnwatchedWorkspaces & workspaceBit) == 0) {
+				_Log(kLogError, "Workspace %" B_PRIi32 " has %" B_PRIi32 " folders which can't be watched, they"
+					" are scanned again every %" B_PRIi64 " minutes", workspace, unwatched,
+					kRescanInterval / 60000000);
+			}
+			fUnwatchedWorkspaces |= workspaceBit;
+		} else
+			fUnwatchedWorkspaces &= ~workspaceBit;
+
+		_SetLibraryFiles(workspace, scan.files);
+	}
+
+	_UpdateRescanRunner();
+
+	if (fRotatePending) {
+		fRotatePending = false;
+		_RotateBackgrounds();
+	}
+}
+
+
 status_t
-WallrusApp::_RescanDirectories(int32 workspace)
+WallrusApp::_RefillRotation(int32 workspace)
 {
 	TRACEF("%" B_PRIi32, workspace);
 
-	if (!fSettingsFolderMap.ContainsKey(HashKey32<int32>(workspace)))
-		return B_ERROR;
+	// start a new round with every file in the library
+	std::vector<uint32>& fileList = fWorkspaceFileMap[workspace];
+	fileList = fWorkspaceLibrary[workspace];
+
+	if (fileList.empty())
+		return B_ENTRY_NOT_FOUND;
+
+	return B_OK;
+}
 
-	BObjectList<BString>* folderList = fSettingsFolderMap.Get(HashKey32<int32>(workspace));
 
-	if (folderList->CountItems() == 0)
+status_t
+WallrusApp::_WatchDirectory(int32 workspace, const char* path)
+{
+	node_ref ref;
+	if (BNode(path).GetNodeRef(&ref) != B_OK)
 		return B_ERROR;
 
-	status_t result = B_ERROR;
-	for (int32 x = 0; x < folderList->CountItems(); x++) {
-		if (_ScanDirectory(workspace, folderList->ItemAt(x)->String(), false) == B_OK)
-			// we found at least one valid directory with files
-			result = B_OK;
+	// folders shared by several workspaces are only watched once
+	watched_directory& watched = fWatchedDirectories[ref];
+	if (watched.workspaces == 0) {
+		if (watch_node(&ref, B_WATCH_DIRECTORY, this) != B_OK) {
+			_Log(kLogDebug, "Unable to watch folder %s", path);
+			fWatchedDirectories.erase(ref);
+			return B_ERROR;
+		}
+		watched.path = path;
 	}
+	watched.workspaces |= (uint64)1 << workspace;
 
-	return result;
+	return B_OK;
+}
+
+
+void
+WallrusApp::_HandleDirectoryEvent(BMessage* message)
+{
+	const char* name = message->GetString("name", nullptr);
+	if (name == nullptr)
+		return;
+
+	node_ref directoryRef;
+	directoryRef.device = message->GetInt32("device", -1);
+
+	switch (message->GetInt32("opcode", 0)) {
+		case B_ENTRY_CREATED:
+			directoryRef.node = message->GetInt64("directory", -1);
+			_AddLibraryEntry(directoryRef, name);
+			break;
+		case B_ENTRY_REMOVED:
+			directoryRef.node = message->GetInt64("directory", -1);
+			_RemoveLibraryEntry(directoryRef, name);
+			break;
+		case B_ENTRY_MOVED:
+			// either side may be outside of the watched folders
+			directoryRef.node = message->GetInt64("from directory", -1);
+			_RemoveLibraryEntry(directoryRef, message->GetString("from name", name));
+			directoryRef.node = message->GetInt64("to directory", -1);
+			_AddLibraryEntry(directoryRef, name);
+			break;
+	}
+}
+
+
+void
+WallrusApp::_AddLibraryEntry(const node_ref& directoryRef, const char* name)
+{
+	std::map<node_ref, watched_directory>::const_iterator watched = fWatchedDirectories.find(directoryRef);
+	if (watched == fWatchedDirectories.end())
+		return;
+
+	// joined like the scanner joins them so the path matches the one it reported
+	BString path(DirectoryScanner::ChildPath(watched->second.path.String(), name).c_str());
+	uint64 workspaces = watched->second.workspaces;
+
+	BEntry entry(path.String(), true);
+	if (entry.IsDirectory()) {
+		// a new folder, or one moved here, may already contain files and folders
+		DirectoryScanner scanner;
+		std::vector<std::string> files;
+		std::vector<std::string> directories;
+		if (scanner.Scan({path.String()}, files, &directories) != B_OK)
+			return;
+
+		for (int32 workspace = 1; workspace <= 32; workspace++) {
+			if ((workspaces & ((uint64)1 << workspace)) == 0)
+				continue;
+
+			for (const std::string& directory : directories) {
+				if (_WatchDirectory(workspace, directory.c_str()) != B_OK)
+					fUnwatchedWorkspaces |= (uint64)1 << workspace;
+			}
+		}
+
+		// folders over the node monitor limit are picked up by the next rescan
+		_UpdateRescanRunner();
+
+		_AddLibraryFiles(workspaces, files);
+	} else if (entry.IsFile() && name[0] != '.')
+		_AddLibraryFiles(workspaces, {path.String()});
+}
+
+
+void
+WallrusApp::_RemoveLibraryEntry(const node_ref& directoryRef, const char* name)
+{
+	std::map<node_ref, watched_directory>::const_iterator watched = fWatchedDirectories.find(directoryRef);
+	if (watched == fWatchedDirectories.end())
+		return;
+
+	// joined like the scanner joins them so the path matches the one it reported
+	BString path(DirectoryScanner::ChildPath(watched->second.path.String(), name).c_str());
+	uint64 workspaces = watched->second.workspaces;
+
+	// when a folder goes away everything below it goes too
+	std::vector<uint32> removed;
+	fPaths.FindBelow(path.String(), removed);
+	std::sort(removed.begin(), removed.end());
+	auto isRemoved = [&removed](uint32 id) {
+		return std::binary_search(removed.begin(), removed.end(), id);
+	};
+
+	for (int32 workspace = 1; workspace <= 32; workspace++) {
+		if ((workspaces & ((uint64)1 << workspace)) == 0 || removed.empty())
+			continue;
+
+		std::vector<uint32>& library = fWorkspaceLibrary[workspace];
+		library.erase(std::remove_if(library.begin(), library.end(), isRemoved), library.end());
+
+		std::map<int32, std::vector<uint32>>::iterator fileList = fWorkspaceFileMap.find(workspace);
+		if (fileList == fWorkspaceFileMap.end())
+			continue;
+
+		for (int32 x = fileList->second.size() - 1; x >= 0; x--) {
+			uint32 id = fileList->second[x];
+			if (isRemoved(id)) {
+				_Log(kLogDebug, "Workspace %" B_PRIi32 " removing %s", workspace, fPaths.PathAt(id).c_str());
+				fileList->second.erase(fileList->second.begin() + x);
+			}
+		}
+	}
+
+	BString prefix(path);
+	prefix << "/";
+
+	// folders which were moved elsewhere are picked up again by the event for their new parent
+	std::map<node_ref, watched_directory>::iterator directory = fWatchedDirectories.begin();
+	while (directory != fWatchedDirectories.end()) {
+		if (directory->second.path == path || directory->second.path.StartsWith(prefix.String())) {
+			watch_node(&directory->first, B_STOP_WATCHING, this);
+			directory = fWatchedDirectories.erase(directory);
+		} else
+			directory++;
+	}
+}
+
+
+void
+WallrusApp::_UpdateRescanRunner()
+{
+	if (fUnwatchedWorkspaces == 0) {
+		delete fRescanRunner;
+		fRescanRunner = nullptr;
+	} else if (fRescanRunner == nullptr) {
+		BMessage rescanMessage(kRescanWhat);
+		fRescanRunner = new BMessageRunner(this, &rescanMessage, kRescanInterval);
+	}
+}
+
+
+std::vector<uint32>
+WallrusApp::_AddPaths(const std::vector<std::string>& files)
+{
+	// the ids are sorted and unique so the libraries can be merged with them
+	std::vector<uint32> ids;
+	ids.reserve(files.size());
+	for (const std::string& file : files) {
+		uint32 id = fPaths.Add(file);
+		if (id == PathStore::kInvalidId) {
+			_Log(kLogError, "Too many files, unable to add %s", file.c_str());
+			continue;
+		}
+		ids.push_back(id);
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	return ids;
+}
+
+
+void
+WallrusApp::_SetLibraryFiles(int32 workspace, const std::vector<std::string>& files)
+{
+	std::vector<uint32> ids = _AddPaths(files);
+	std::vector<uint32>& library = fWorkspaceLibrary[workspace];
+	std::vector<uint32>& fileList = fWorkspaceFileMap[workspace];
+
+	// files which are gone leave the current round of the rotation, new ones join it
+	auto isGone = [&ids](uint32 id) {
+		return !std::binary_search(ids.begin(), ids.end(), id);
+	};
+	fileList.erase(std::remove_if(fileList.begin(), fileList.end(), isGone), fileList.end());
+	std::set_difference(ids.begin(), ids.end(), library.begin(), library.end(), std::back_inserter(fileList));
+
+	_Log(kLogDebug, "Workspace %" B_PRIi32 " has %" B_PRIi32 " files", workspace, (int32)ids.size());
+	library.swap(ids);
+}
+
+
+void
+WallrusApp::_AddLibraryFiles(uint64 workspaces, const std::vector<std::string>& files)
+{
+	std::vector<uint32> ids = _AddPaths(files);
+
+	for (int32 workspace = 1; workspace <= 32; workspace++) {
+		if ((workspaces & ((uint64)1 << workspace)) == 0)
+			continue;
+
+		// new files can be picked in the current round of the rotation
+		std::vector<uint32>& library = fWorkspaceLibrary[workspace];
+		std::vector<uint32>& fileList = fWorkspaceFileMap[workspace];
+		size_t librarySize = library.size();
+		for (uint32 id : ids) {
+			if (std::binary_search(library.begin(), library.begin() + librarySize, id))
+				continue;
+
+			library.push_back(id);
+			fileList.push_back(id);
+			// only build the path when it is going to be logged
+			if ((fLogLevel & kLogDebug) != 0)
+				_Log(kLogDebug, "Workspace %" B_PRIi32 " adding %s", workspace, fPaths.PathAt(id).c_str());
+		}
+
+		std::inplace_merge(library.begin(), library.begin() + librarySize, library.end());
+	}
+}
+
+
+size_t
+WallrusApp::_LibraryMemoryUsage() const
+{
+	// the scan index is only loaded while scanning, the path cache of fBackgroundManager
+	// is only filled during a transaction
+	size_t bytes = fPaths.MemoryUsage();
+	for (const auto& entry : fWorkspaceLibrary)
+		bytes += entry.second.capacity() * sizeof(uint32);
+	for (const auto& entry : fWorkspaceFileMap)
+		bytes += entry.second.capacity() * sizeof(uint32);
+
+	return bytes;
 }
 
 
 status_t
-WallrusApp::_ScanDirectory(int32 workspace, const char* path, bool cachePath)
+WallrusApp::_AddDirectory(int32 workspace, const char* path)
 {
-	TRACEF("%" B_PRIi32 ", \"%s\", %d", workspace, path, cachePath)
+	TRACEF("%" B_PRIi32 ", \"%s\"", workspace, path)
 
 	// TODO better sanity check on path
 	if (workspace < 1 || workspace > 32 || path == nullptr)
@@ -199,51 +660,35 @@ WallrusApp::_ScanDirectory(int32 workspace, const char* path, bool cachePath)
 	if (dir.InitCheck() != B_OK)
 		return B_ERROR;
 
-	if (cachePath) {
-		// store configured paths in fSettingsFolderMap so we can rescan
-		if (!fSettingsFolderMap.ContainsKey(workspace))
-			fSettingsFolderMap.Put(workspace,
-#if B_HAIKU_VERSION > B_HAIKU_VERSION_1_BETA_5
-				new BObjectList<BString>(20));
-#else
-				new BObjectList<BString>(20, true));
-#endif
-
-		BObjectList<BString>* folderList = fSettingsFolderMap.Get(workspace);
-		folderList->AddItem(new BString(path));
-	}
+	// the files found below the folder and the node monitor events only match when every
+	// path is built from the same spelling of it, without trailing slashes or ".."
+	BPath normalized(path, nullptr, true);
+	if (normalized.InitCheck() != B_OK)
+		return B_ERROR;
 
-	if (!fWorkspaceFileMap.ContainsKey(workspace))
-		fWorkspaceFileMap.Put(workspace,
+	// store configured paths in fSettingsFolderMap so we can rescan
+	if (!fSettingsFolderMap.ContainsKey(workspace))
+		fSettingsFolderMap.Put(workspace,
 #if B_HAIKU_VERSION > B_HAIKU_VERSION_1_BETA_5
 			new BObjectList<BString>(20));
 #else
 			new BObjectList<BString>(20, true));
 #endif
 
-	BEntry entry;
-	while (dir.GetNextEntry(&entry, true) != B_ENTRY_NOT_FOUND) {
-		BPath subPath;
-		entry.GetPath(&subPath);
+	BObjectList<BString>* folderList = fSettingsFolderMap.Get(workspace);
+	folderList->AddItem(new BString(normalized.Path()));
 
-		if (entry.IsDirectory()) {
-			// recurse
-			_ScanDirectory(workspace, subPath.Path(), cachePath);
-			continue;
-		}
-
-		// TODO filter out non-images in addition to dot files
-		if (subPath.Leaf()[0] == '.')
-			continue;
+	return B_OK;
+}
 
-		// add paths to rotation list
-		BObjectList<BString>* fileList = fWorkspaceFileMap.Get(workspace);
-		fileList->AddItem(new BString(subPath.Path()));
 
-		_Log(kLogDebug, "Workspace %" B_PRIi32 " adding %s", workspace, subPath.Path());
-	}
+status_t
+WallrusApp::_GetScanIndexPath(BPath& path)
+{
+	if (find_directory(B_USER_SETTINGS_DIRECTORY, &path) != B_OK)
+		return B_ERROR;
 
-	return B_OK;
+	return path.Append("wallrus_scan_index");
 }
 
 
@@ -262,8 +707,10 @@ WallrusApp::_LoadSettings()
 	if (settingsFile.InitCheck() != B_OK)
 		return B_ERROR;
 
-	// add node monitor to settings file
+	// add node monitor to settings file, this also stops watching the image folders
 	stop_watching(this);
+	fWatchedDirectories.clear();
+	fUnwatchedWorkspaces = 0;
 	node_ref ref;
 	settingsFile.GetNodeRef(&ref);
 	// TODO watch for newly created settings files too
@@ -326,16 +773,19 @@ WallrusApp::_LoadSettings()
 		if (workspacesTable != nullptr) {
 			workspacesTable->for_each([this](const toml::key& workspace, auto&& paths) {
 				if (paths.is_string())
-					_ScanDirectory(atol(workspace.data()), paths.as_string()->get().c_str(), true);
+					_AddDirectory(atol(workspace.data()), paths.as_string()->get().c_str());
 				else if (paths.is_array()) {
 					toml::array* pathArray = paths.as_array();
 					for (auto&& pathElement: *pathArray) {
 						if (pathElement.is_string())
-							_ScanDirectory(atol(workspace.data()), pathElement.value<std::string>().value().c_str(), true);
+							_AddDirectory(atol(workspace.data()), pathElement.value<std::string>().value().c_str());
 					}
 				}
 			});
 		}
+
+		// scan once all of the folders of every workspace are known
+		_StartScan();
 	} catch (const toml::parse_error& err) {
 		// TODO log exact error message
 		_Log(kLogError, "Failed to parse settings file");
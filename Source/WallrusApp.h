@@ -3,11 +3,19 @@
 
 
 #include "BackgroundManager.h"
+#include "DirectoryScanner.h"
+#include "PathStore.h"
 
 #include <File.h>
+#include <Messenger.h>
+#include <Node.h>
 #include <ObjectList.h>
+#include <Path.h>
 #include <private/app/Server.h>
 #include <private/shared/HashMap.h>
+#include <map>
+#include <string>
+#include <vector>
 
 
 #define TRACE _Log(kLogTrace, "%s()", __FUNCTION__);
@@ -23,6 +31,42 @@ enum LogLevel {
 };
 
 
+// An image folder being node monitored.  Bit N of workspaces is set when workspace N uses it.
+struct watched_directory {
+	watched_directory() :
+		workspaces(0)
+	{
+	}
+
+	BString path;
+	uint64 workspaces;
+};
+
+
+// The folders of the workspaces, listed by a thread of their own so the looper keeps
+// handling messages.  The results are handed back in a message once all are done.
+struct scan_job {
+	struct workspace_scan {
+		std::vector<std::string> roots;
+		std::vector<std::string> files;
+		std::vector<std::string> directories;
+		status_t status;
+		int32 directoryCount;
+		int32 indexedCount;
+		bigtime_t time;
+	};
+
+	BMessenger target;
+	// empty when there is no settings folder to keep the index in
+	std::string indexPath;
+	bool saveIndex;
+	int32 indexEntries;
+	int32 threadCount;
+	status_t indexStatus;
+	std::map<int32, workspace_scan> workspaces;
+};
+
+
 class WallrusApp : public BServer {
 public:
 	WallrusApp();
@@ -37,8 +81,23 @@ private:
 	status_t _ResetMaps();
 	status_t _ResetMessageRunner();
 	status_t _RotateBackgrounds();
-	status_t _RescanDirectories(int32 workspace);
-	status_t _ScanDirectory(int32 workspace, const char* path, bool cachePath);
+	status_t _ApplyEdits(const background_edit* edits, int32 count);
+	// 0 scans every workspace of the settings, otherwise only the given ones are scanned again
+	void _StartScan(uint64 rescanWorkspaces = 0);
+	static status_t _ScanThread(void* data);
+	void _ScanDone(BMessage* message);
+	status_t _RefillRotation(int32 workspace);
+	status_t _AddDirectory(int32 workspace, const char* path);
+	status_t _WatchDirectory(int32 workspace, const char* path);
+	void _HandleDirectoryEvent(BMessage* message);
+	void _AddLibraryEntry(const node_ref& directoryRef, const char* name);
+	void _RemoveLibraryEntry(const node_ref& directoryRef, const char* name);
+	void _UpdateRescanRunner();
+	std::vector<uint32> _AddPaths(const std::vector<std::string>& files);
+	void _SetLibraryFiles(int32 workspace, const std::vector<std::string>& files);
+	void _AddLibraryFiles(uint64 workspaces, const std::vector<std::string>& files);
+	size_t _LibraryMemoryUsage() const;
+	status_t _GetScanIndexPath(BPath& path);
 	status_t _LoadSettings();
 
 	void _ScriptReceived(BMessage* message);
@@ -50,13 +109,29 @@ private:
 	template<typename... Args>
 	status_t _Log(LogLevel level, const char* message, Args...);
 
+	// phases of the last load or change made by fBackgroundManager, for the debug log
+	PhaseTimings fTimings;
 	BackgroundManager fBackgroundManager;
 	bigtime_t fRotateTime;
 	BMessageRunner* fRotateRunner;
-	HashMap<HashKey32<int32>, BObjectList<BString>*> fWorkspaceFileMap;
+	// every file found in the folders of all workspaces, the lists below hold their ids
+	PathStore fPaths;
+	// files not shown yet in the current round of the rotation
+	std::map<int32, std::vector<uint32>> fWorkspaceFileMap;
+	// every file found in the folders of each workspace sorted by id, kept up to date by node monitoring
+	std::map<int32, std::vector<uint32>> fWorkspaceLibrary;
+	std::map<node_ref, watched_directory> fWatchedDirectories;
 	HashMap<HashKey32<int32>, BObjectList<BString>*> fSettingsFolderMap;
 	BFile fLogFile;
 	int32 fLogLevel;
+	// only one scan runs at a time, settings changed while it runs start another one
+	thread_id fScanThread;
+	bool fScanPending;
+	// the first rotation waits for the folders to be scanned
+	bool fRotatePending;
+	// workspaces with folders which couldn't be node monitored, bit N for workspace N
+	uint64 fUnwatchedWorkspaces;
+	BMessageRunner* fRescanRunner;
 };
 
 #include "WallrusAppImpl.h"
@@ -6,6 +6,7 @@
 
 #include <PropertyInfo.h>
 #include <iostream>
+#include <vector>
 
 
 #pragma GCC diagnostic push
@@ -27,6 +28,30 @@ static property_info prop_list[] = {
 		0,
 		0,
 	},
+	{
+		"Apply",
+		{B_EXECUTE_PROPERTY, 0},
+		{B_DIRECT_SPECIFIER, 0},
+		"Apply background changes sent by bgswitch in a single transaction",
+		0,
+		0,
+	},
+	{
+		"Import",
+		{B_EXECUTE_PROPERTY, 0},
+		{B_DIRECT_SPECIFIER, 0},
+		"Replace all background settings with a snapshot exported by bgswitch",
+		0,
+		{B_RAW_TYPE},
+	},
+	{
+		"Compact",
+		{B_EXECUTE_PROPERTY, 0},
+		{B_DIRECT_SPECIFIER, 0},
+		"Merge workspaces with identical settings into shared entries",
+		0,
+		{B_INT32_TYPE},
+	},
 	{
 		"RotateTime",
 		{B_GET_PROPERTY, B_SET_PROPERTY, 0},
@@ -43,6 +68,14 @@ static property_info prop_list[] = {
 		0,
 		{B_STRING_TYPE},
 	},
+	{
+		"MemoryUsage",
+		{B_GET_PROPERTY, 0},
+		{B_DIRECT_SPECIFIER, 0},
+		"Get the approximate bytes used by the image file lists",
+		0,
+		{B_INT64_TYPE},
+	},
 	{
 		"Workspace",
 		{B_GET_SUPPORTED_SUITES, 0},
@@ -201,6 +234,8 @@ WallrusApp::_ScriptReceived(BMessage* message)
 		case B_EXECUTE_PROPERTY:
 		{
 			_Log(kLogInfo, "Executing '%s' command...", property);
+			status_t status = B_OK;
+			int32 merged = 0;
 			// check for individual commands to execute
 			if (strcmp(property, "Next") == 0) {
 				_ResetMessageRunner();
@@ -209,9 +244,32 @@ WallrusApp::_ScriptReceived(BMessage* message)
 				// TODO reset all settings to defaults before loading
 				_LoadSettings();
 				// TODO switch to next wallpaper?
+			} else if (strcmp(property, "Apply") == 0) {
+				std::vector<background_edit> edits;
+				status = BackgroundManager::GetEditsFromMessage(message, edits);
+				if (status == B_OK)
+					status = _ApplyEdits(edits.data(), edits.size());
+				else
+					_Log(kLogError, "Invalid background changes received");
+			} else if (strcmp(property, "Import") == 0) {
+				const void* data = nullptr;
+				ssize_t size = 0;
+				status = message->FindData("data", B_RAW_TYPE, 0, &data, &size);
+				if (status == B_OK)
+					status = fBackgroundManager.ImportSnapshot(data, size);
+				if (status != B_OK)
+					_Log(kLogError, "Unable to import background snapshot");
+			} else if (strcmp(property, "Compact") == 0) {
+				status = fBackgroundManager.Compact(&merged);
+				// nothing to write if no entries were merged, Tracker isn't bothered then
+				if (status == B_OK && merged > 0)
+					status = fBackgroundManager.Flush();
+				if (status != B_OK)
+					_Log(kLogError, "Unable to compact background settings");
 			}
 			BMessage reply(B_REPLY);
-			reply.AddInt32("error", B_OK);
+			reply.AddInt32("error", status);
+			reply.AddInt32("merged", merged);
 			message->SendReply(&reply);
 		} break;
 		case B_SET_PROPERTY:
@@ -228,7 +286,46 @@ WallrusApp::_HandleScriptSet(BMessage* message, const char* property)
 {
 	TRACEF("..., \"%s\"", property)
 
-	message->PrintToStream();
+	// handle script requests for 'Workspace XX'
+	BMessage specifier;
+	message->SetCurrentSpecifier(1);
+	if (message->GetCurrentSpecifier(nullptr, &specifier, nullptr, nullptr) != B_OK) {
+		message->PrintToStream();
+		return;
+	}
+
+	int32 workspace = specifier.GetInt32("index", -1);
+	if (workspace < 0 || workspace > 32)
+		// TODO reply with index error?
+		return;
+
+	background_edit edit(kEditImage, (uint64)1 << workspace);
+	status_t status = B_OK;
+	if (strcmp(property, "Background") == 0) {
+		status = message->FindString("data", &edit.path);
+	} else if (strcmp(property, "TextOutline") == 0) {
+		edit.field = kEditOutline;
+		status = message->FindBool("data", &edit.outline);
+	} else if (strcmp(property, "Placement") == 0) {
+		edit.field = kEditMode;
+		status = message->FindInt32("data", &edit.mode);
+	} else if (strcmp(property, "Offset") == 0) {
+		edit.field = kEditOffset;
+		status = message->FindPoint("data", &edit.offset);
+	} else if (strcmp(property, "Color") == 0) {
+		edit.field = kEditColor;
+		status = message->FindColor("data", &edit.color);
+	} else {
+		message->PrintToStream();
+		return;
+	}
+
+	if (status == B_OK)
+		status = _ApplyEdits(&edit, 1);
+
+	BMessage reply(B_REPLY);
+	reply.AddInt32("error", status);
+	message->SendReply(&reply);
 }
 
 
@@ -263,6 +360,12 @@ WallrusApp::_HandleScriptGet(BMessage* message, const char* property)
 		reply.AddInt32("error", B_OK);
 		message->SendReply(&reply);
 		return;
+	} else if (strcmp(property, "MemoryUsage") == 0) {
+		reply.AddInt64("result", _LibraryMemoryUsage());
+		reply.AddInt32("images", fPaths.CountPaths());
+		reply.AddInt32("error", B_OK);
+		message->SendReply(&reply);
+		return;
 	}
 
 	// handle script requests for 'Workspace XX'
@@ -272,29 +375,27 @@ WallrusApp::_HandleScriptGet(BMessage* message, const char* property)
 		return;
 
 	int32 workspace = specifier.GetInt32("index", -1);
-	// TODO better check if workspace is valid
-	if (workspace < 0)
+	if (workspace < 0 || workspace > 32)
 		// TODO reply with index error?
 		return;
 
-	BString bgPath;
-	int32 bgMode = -1;
-	BPoint bgOffset;
-	bool bgErase = false;
-	rgb_color bgColor = {0, 0, 0, 0};
-	// TODO check for errors from GetWorkspaceInfo()
-	fBackgroundManager.GetWorkspaceInfo(workspace, bgPath, &bgMode, &bgOffset, &bgErase, &bgColor);
+	// the color may have been changed by another app since it was read
+	fBackgroundManager.InvalidateDesktopColors();
+
+	workspace_info info[33];
+	if (fBackgroundManager.GetAllWorkspaceInfo(info) != B_OK)
+		return;
 
 	if (strcmp(property, "Background") == 0) {
-		reply.AddString("result", bgPath);
+		reply.AddString("result", info[workspace].path);
 	} else if (strcmp(property, "TextOutline") == 0) {
-		reply.AddBool("result", bgErase);
+		reply.AddBool("result", info[workspace].erase);
 	} else if (strcmp(property, "Placement") == 0) {
-		reply.AddInt32("result", bgMode);
+		reply.AddInt32("result", info[workspace].mode);
 	} else if (strcmp(property, "Offset") == 0) {
-		reply.AddPoint("result", bgOffset);
+		reply.AddPoint("result", info[workspace].offset);
 	} else if (strcmp(property, "Color") == 0) {
-		reply.AddColor("result", bgColor);
+		reply.AddColor("result", info[workspace].color);
 	} else {
 		message->PrintToStream();
 		return;
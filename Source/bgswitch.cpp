@@ -6,14 +6,41 @@
 #include "argparse.hpp"
 
 #include <Application.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <FindDirectory.h>
+#include <Handler.h>
 #include <InterfaceDefs.h>
+#include <MessageRunner.h>
+#include <Messenger.h>
+#include <Node.h>
+#include <NodeMonitor.h>
+#include <OS.h>
+#include <Path.h>
+#include <Roster.h>
+#include <Screen.h>
 #include <be_apps/Tracker/Background.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <unistd.h>
+#include <vector>
 
 #define Q(x) #x
 #define QUOTE(x) Q(x)
 
 
+// filled in by every BackgroundManager, printed at exit with --timings
+static PhaseTimings sTimings;
+static bool sShowTimings = false;
+// compact was used in a batch, Wallrus has to be asked to do it after the edits
+static bool sBatchCompact = false;
+
+
 void
 _print_subhelp(argparse::ArgumentParser& parser)
 {
@@ -25,24 +52,635 @@ _print_subhelp(argparse::ArgumentParser& parser)
 		std::cerr << parser.at<argparse::ArgumentParser>("clear") << std::endl;
 	else if (parser.is_subcommand_used("reset"))
 		std::cerr << parser.at<argparse::ArgumentParser>("reset") << std::endl;
+	else if (parser.is_subcommand_used("compact"))
+		std::cerr << parser.at<argparse::ArgumentParser>("compact") << std::endl;
+	else if (parser.is_subcommand_used("watch"))
+		std::cerr << parser.at<argparse::ArgumentParser>("watch") << std::endl;
+	else if (parser.is_subcommand_used("export"))
+		std::cerr << parser.at<argparse::ArgumentParser>("export") << std::endl;
+	else if (parser.is_subcommand_used("import"))
+		std::cerr << parser.at<argparse::ArgumentParser>("import") << std::endl;
+	else if (parser.is_subcommand_used("profile"))
+		std::cerr << parser.at<argparse::ArgumentParser>("profile") << std::endl;
 	else
 		std::cerr << parser;
 }
 
 
-int32
-_check_workspace(int32 workspace)
+status_t
+_parse_workspaces(const std::string& list, int32 maxWorkspace, uint64& workspaces)
 {
-	if (workspace < 0 || workspace > count_workspaces()) {
+	// a comma separated list of workspaces and ranges, ex. 2,5,9-12
+	workspaces = 0;
+	const char* start = list.c_str();
+	const char* end = start + list.length();
+	while (start < end) {
+		int32 first = -1;
+		std::from_chars_result result = std::from_chars(start, end, first);
+		int32 last = first;
+		if (result.ec == std::errc() && result.ptr < end && *result.ptr == '-')
+			result = std::from_chars(result.ptr + 1, end, last);
+
+		if (result.ec != std::errc() || (result.ptr < end && *result.ptr != ',')
+			|| first < 0 || last < first || last > 32) {
+			std::cerr << "Error: invalid workspace # specified" << std::endl;
+			return B_BAD_VALUE;
+		}
+
+		for (int32 x = first; x <= last; x++)
+			workspaces |= (uint64)1 << x;
+
+		start = result.ptr + 1;
+	}
+
+	if (workspaces == 0 || list.back() == ',' || (workspaces >> (maxWorkspace + 1)) != 0) {
 		std::cerr << "Error: invalid workspace # specified" << std::endl;
-		exit(1);
+		return B_BAD_VALUE;
+	}
+
+	return B_OK;
+}
+
+
+std::vector<int32>
+_workspace_list(uint64 workspaces)
+{
+	std::vector<int32> list;
+	for (int32 x = 0; x <= 32; x++) {
+		if ((workspaces & ((uint64)1 << x)) != 0)
+			list.push_back(x);
+	}
+
+	return list;
+}
+
+
+const char*
+_mode_name(int32 mode)
+{
+	switch (mode) {
+		case B_BACKGROUND_MODE_USE_ORIGIN:
+			return "manual";
+		case B_BACKGROUND_MODE_CENTERED:
+			return "centered";
+		case B_BACKGROUND_MODE_SCALED:
+			return "scaled";
+		case B_BACKGROUND_MODE_TILED:
+			return "tiled";
+		default:
+			return "unknown";
+	}
+}
+
+
+void
+_append_json_string(std::string& output, const char* string)
+{
+	output += '"';
+	for (const char* c = string; *c != '\0'; c++) {
+		switch (*c) {
+			case '"':
+				output += "\\\"";
+				break;
+			case '\\':
+				output += "\\\\";
+				break;
+			case '\n':
+				output += "\\n";
+				break;
+			case '\t':
+				output += "\\t";
+				break;
+			default:
+				if ((uint8)*c < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+					output += escaped;
+				} else
+					output += *c;
+				break;
+		}
+	}
+	output += '"';
+}
+
+
+void
+_append_json(std::string& output, int32 workspace, const workspace_info& info)
+{
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "{\"workspace\":%" B_PRIi32 ",\"default\":%s,\"file\":",
+		workspace, info.followsDefault ? "true" : "false");
+	output += buffer;
+	_append_json_string(output, info.path);
+
+	snprintf(buffer, sizeof(buffer), ",\"mode\":\"%s\",\"offset\":{\"x\":%g,\"y\":%g},\"text_outline\":%s,\"color\":",
+		_mode_name(info.mode), info.offset.x, info.offset.y, info.erase ? "true" : "false");
+	output += buffer;
+
+	// the global default doesn't have a color
+	if (workspace == 0)
+		output += "null}";
+	else {
+		snprintf(buffer, sizeof(buffer), "{\"r\":%u,\"g\":%u,\"b\":%u}}",
+			info.color.red, info.color.green, info.color.blue);
+		output += buffer;
+	}
+}
+
+
+static const char* const kTsvHeader
+	= "workspace\tdefault\tfile\tmode\toffset_x\toffset_y\ttext_outline\tred\tgreen\tblue\n";
+
+
+void
+_append_tsv(std::string& output, int32 workspace, const workspace_info& info)
+{
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%" B_PRIi32 "\t%s\t", workspace, info.followsDefault ? "true" : "false");
+	output += buffer;
+
+	// keep one workspace per line, even with odd file names
+	for (const char* c = info.path; *c != '\0'; c++) {
+		if (*c == '\t')
+			output += "\\t";
+		else if (*c == '\n')
+			output += "\\n";
+		else if (*c == '\\')
+			output += "\\\\";
+		else
+			output += *c;
+	}
+
+	snprintf(buffer, sizeof(buffer), "\t%s\t%g\t%g\t%s", _mode_name(info.mode), info.offset.x, info.offset.y,
+		info.erase ? "true" : "false");
+	output += buffer;
+
+	if (workspace == 0)
+		output += "\t\t\t\n";
+	else {
+		snprintf(buffer, sizeof(buffer), "\t%u\t%u\t%u\n", info.color.red, info.color.green, info.color.blue);
+		output += buffer;
 	}
-	return workspace;
+}
+
+
+status_t
+_write_output(const std::string& output)
+{
+	// everything goes out in one write instead of flushing line by line
+	size_t written = 0;
+	while (written < output.length()) {
+		ssize_t result = write(STDOUT_FILENO, output.data() + written, output.length() - written);
+		if (result < 0) {
+			std::cerr << "Error: unable to write output" << std::endl;
+			return B_IO_ERROR;
+		}
+		written += result;
+	}
+
+	return B_OK;
+}
+
+
+// the desktop colors are kept by the app_server, which doesn't report changes
+static const uint32 kWatchColorsWhat = 'WCLR';
+static const bigtime_t kWatchColorsInterval = 1000000;
+
+
+// Reloads the settings whenever the background attribute is written and prints
+// the watched workspaces which are different from the last time they were read.
+// With --colors the desktop colors of the watched workspaces are checked every
+// kWatchColorsInterval.
+class WatchHandler : public BHandler {
+public:
+	WatchHandler(BackgroundManager* manager, const std::vector<int32>& workspaceList,
+		const std::string& format, bool verbose);
+
+	virtual void MessageReceived(BMessage* message);
+
+private:
+	void _Update(bool print);
+	bool _ColorsChanged();
+
+	BackgroundManager* fManager;
+	BScreen fScreen;
+	std::vector<int32> fWorkspaceList;
+	std::string fFormat;
+	bool fVerbose;
+	// the workspace_info paths point into fManager and are gone after a reload, keep copies
+	workspace_info fLastInfo[33];
+	std::string fLastPaths[33];
+};
+
+
+WatchHandler::WatchHandler(BackgroundManager* manager, const std::vector<int32>& workspaceList,
+	const std::string& format, bool verbose) :
+	BHandler("bgswitch watch"),
+	fManager(manager),
+	fWorkspaceList(workspaceList),
+	fFormat(format),
+	fVerbose(verbose)
+{
+	_Update(false);
+}
+
+
+void
+WatchHandler::MessageReceived(BMessage* message)
+{
+	if (message->what == kWatchColorsWhat) {
+		// everything is only read again when one of the watched colors is different
+		if (_ColorsChanged()) {
+			fManager->InvalidateDesktopColors();
+			_Update(true);
+		}
+		return;
+	}
+
+	if (message->what != B_NODE_MONITOR) {
+		BHandler::MessageReceived(message);
+		return;
+	}
+
+	// other attributes on the Desktop folder change all the time
+	const char* attrName = nullptr;
+	if (message->GetInt32("opcode", 0) != B_ATTR_CHANGED
+		|| message->FindString("attr", &attrName) != B_OK
+		|| strcmp(attrName, B_BACKGROUND_INFO) != 0)
+		return;
+
+	if (fManager->Reload() != B_OK) {
+		std::cerr << "Error: unable to reload the background settings" << std::endl;
+		return;
+	}
+
+	_Update(true);
+}
+
+
+bool
+WatchHandler::_ColorsChanged()
+{
+	for (int32 x : fWorkspaceList) {
+		// the global defaults have no desktop color
+		if (x > 0 && fScreen.DesktopColor(x - 1) != fLastInfo[x].color)
+			return true;
+	}
+
+	return false;
+}
+
+
+void
+WatchHandler::_Update(bool print)
+{
+	workspace_info info[33];
+	if (fManager->GetAllWorkspaceInfo(info) != B_OK)
+		return;
+
+	std::string output;
+	for (int32 x : fWorkspaceList) {
+		const workspace_info& last = fLastInfo[x];
+		// the first update only records the settings
+		bool changed = !print
+			|| fLastPaths[x] != info[x].path
+			|| last.mode != info[x].mode
+			|| last.offset != info[x].offset
+			|| last.erase != info[x].erase
+			|| last.color != info[x].color
+			|| last.followsDefault != info[x].followsDefault;
+		if (!changed)
+			continue;
+
+		fLastInfo[x] = info[x];
+		fLastPaths[x] = info[x].path;
+		fLastInfo[x].path = fLastPaths[x].c_str();
+
+		if (!print)
+			continue;
+
+		// one line per workspace for json, so each change can be parsed as soon as it arrives
+		if (fFormat == "json") {
+			_append_json(output, x, info[x]);
+			output += '\n';
+		} else if (fFormat == "tsv")
+			_append_tsv(output, x, info[x]);
+		else
+			BackgroundManager::PrintBackgroundToStream(x, info[x], fVerbose);
+	}
+
+	if (fFormat == "text")
+		std::cout.flush();
+	else if (!output.empty())
+		_write_output(output);
+}
+
+
+bool
+_split_line(const std::string& line, std::vector<std::string>& args)
+{
+	// split on whitespace like a shell would, quotes and backslashes keep spaces in paths
+	std::string arg;
+	bool inArg = false;
+	char quote = '\0';
+
+	for (size_t x = 0; x < line.length(); x++) {
+		char c = line[x];
+		if (quote != '\0') {
+			if (c == quote)
+				quote = '\0';
+			else if (c == '\\' && quote == '"' && x + 1 < line.length())
+				arg += line[++x];
+			else
+				arg += c;
+		} else if (c == '\'' || c == '"') {
+			quote = c;
+			inArg = true;
+		} else if (c == '\\' && x + 1 < line.length()) {
+			arg += line[++x];
+			inArg = true;
+		} else if (c == ' ' || c == '\t' || c == '\r') {
+			if (inArg)
+				args.push_back(arg);
+			arg.clear();
+			inArg = false;
+		} else if (c == '#' && !inArg) {
+			// the rest of the line is a comment
+			break;
+		} else {
+			arg += c;
+			inArg = true;
+		}
+	}
+
+	if (inArg)
+		args.push_back(arg);
+
+	return quote == '\0';
+}
+
+
+status_t
+_send_edits(const background_edit* edits, int32 count)
+{
+	// Wallrus has a different working directory, send it absolute paths
+	std::vector<background_edit> absoluteEdits(edits, edits + count);
+	for (background_edit& edit : absoluteEdits) {
+		if (edit.field == kEditImage && !edit.path.IsEmpty() && edit.path[0] != '/') {
+			BPath absolutePath(edit.path.String(), nullptr, true);
+			if (absolutePath.InitCheck() != B_OK) {
+				std::cerr << "Error: unable to get full path to file" << std::endl;
+				return B_ERROR;
+			}
+			edit.path = absolutePath.Path();
+		}
+	}
+
+	BMessage message(B_EXECUTE_PROPERTY);
+	message.AddSpecifier("Apply");
+	if (BackgroundManager::AddEditsToMessage(absoluteEdits.data(), absoluteEdits.size(), &message) != B_OK)
+		return B_ERROR;
+
+	BMessage reply;
+	PhaseTimer timer(&sTimings, "send to Wallrus");
+	status_t status = BMessenger(kWallrusSignature).SendMessage(&message, &reply);
+	if (status == B_OK)
+		status = reply.GetInt32("error", B_ERROR);
+
+	if (status != B_OK)
+		std::cerr << "Error: Wallrus was unable to apply the changes: " << strerror(status) << std::endl;
+
+	return status;
+}
+
+
+status_t
+_send_snapshot(const std::vector<char>& snapshot)
+{
+	BMessage message(B_EXECUTE_PROPERTY);
+	message.AddSpecifier("Import");
+	if (message.AddData("data", B_RAW_TYPE, snapshot.data(), snapshot.size()) != B_OK)
+		return B_NO_MEMORY;
+
+	BMessage reply;
+	status_t status = BMessenger(kWallrusSignature).SendMessage(&message, &reply);
+	if (status == B_OK)
+		status = reply.GetInt32("error", B_ERROR);
+
+	if (status != B_OK)
+		std::cerr << "Error: Wallrus was unable to import the snapshot: " << strerror(status) << std::endl;
+
+	return status;
+}
+
+
+status_t
+_send_compact(int32* _merged)
+{
+	BMessage message(B_EXECUTE_PROPERTY);
+	message.AddSpecifier("Compact");
+
+	BMessage reply;
+	status_t status = BMessenger(kWallrusSignature).SendMessage(&message, &reply);
+	if (status == B_OK)
+		status = reply.GetInt32("error", B_ERROR);
+
+	if (status != B_OK)
+		std::cerr << "Error: Wallrus was unable to compact the settings: " << strerror(status) << std::endl;
+	else if (_merged != nullptr)
+		*_merged = reply.GetInt32("merged", 0);
+
+	return status;
+}
+
+
+status_t
+_read_snapshot(const std::string& fileName, std::vector<char>& snapshot)
+{
+	std::ifstream file;
+	std::istream* input = &std::cin;
+	if (fileName != "-") {
+		file.open(fileName, std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Error: unable to open snapshot file " << fileName << std::endl;
+			return B_ENTRY_NOT_FOUND;
+		}
+		input = &file;
+	}
+
+	snapshot.assign(std::istreambuf_iterator<char>(*input), std::istreambuf_iterator<char>());
+	if (input->bad()) {
+		std::cerr << "Error: unable to read snapshot file " << fileName << std::endl;
+		return B_IO_ERROR;
+	}
+
+	return B_OK;
+}
+
+
+status_t
+_write_snapshot(const std::string& fileName, const std::vector<char>& snapshot)
+{
+	if (fileName == "-")
+		return _write_output(std::string(snapshot.data(), snapshot.size()));
+
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "Error: unable to create snapshot file " << fileName << std::endl;
+		return B_ERROR;
+	}
+
+	if (!file.write(snapshot.data(), snapshot.size()) || !file.flush()) {
+		std::cerr << "Error: unable to write snapshot file " << fileName << std::endl;
+		return B_IO_ERROR;
+	}
+
+	return B_OK;
+}
+
+
+status_t
+_profile_directory(BPath& path, bool create)
+{
+	if (find_directory(B_USER_SETTINGS_DIRECTORY, &path) != B_OK || path.Append("bgswitch/profiles") != B_OK) {
+		std::cerr << "Error: unable to find B_USER_SETTINGS_DIRECTORY" << std::endl;
+		return B_ERROR;
+	}
+
+	if (create && create_directory(path.Path(), 0755) != B_OK) {
+		std::cerr << "Error: unable to create profile folder " << path.Path() << std::endl;
+		return B_ERROR;
+	}
+
+	return B_OK;
+}
+
+
+status_t
+_profile_path(const std::string& name, BPath& path, bool create)
+{
+	// each profile is a snapshot file named after it, keep the name from leaving the folder
+	if (name.empty() || name == "." || name == ".." || name.find('/') != std::string::npos) {
+		std::cerr << "Error: invalid profile name" << std::endl;
+		return B_BAD_VALUE;
+	}
+
+	if (_profile_directory(path, create) != B_OK)
+		return B_ERROR;
+
+	return path.Append(name.c_str());
 }
 
 
 int
-main(int argc, char** argv)
+_apply_edits(BackgroundManager* bgManager, const background_edit* edits, int32 count,
+	std::vector<background_edit>* batchEdits)
+{
+	// a batch is a single transaction which is committed, or sent to Wallrus, after the last line
+	if (batchEdits != nullptr) {
+		if (bgManager->Apply(edits, count) != B_OK)
+			return 1;
+
+		batchEdits->insert(batchEdits->end(), edits, edits + count);
+		return 0;
+	}
+
+	// no manager means Wallrus is running and makes the changes
+	if (bgManager == nullptr)
+		return _send_edits(edits, count) == B_OK ? 0 : 1;
+
+	bgManager->Begin();
+	if (bgManager->Apply(edits, count) != B_OK)
+		return 1;
+
+	return bgManager->Commit() == B_OK ? 0 : 1;
+}
+
+
+int _run_command(int argc, char** argv, BackgroundManager*& bgManager, std::vector<background_edit>* batchEdits);
+
+
+int
+_run_batch(const std::string& fileName, BackgroundManager*& bgManager, bool client, bool verbose)
+{
+	std::ifstream file;
+	std::istream* input = &std::cin;
+	if (fileName != "-") {
+		file.open(fileName);
+		if (!file.is_open()) {
+			std::cerr << "Error: unable to open batch file " << fileName << std::endl;
+			return 1;
+		}
+		input = &file;
+	}
+
+	bigtime_t startTime = system_time();
+
+	bgManager = new BackgroundManager(nullptr, &sTimings);
+	if (bgManager->InitCheck() != B_OK)
+		return 1;
+
+	// every line works on the same in-memory settings, nothing is written until the end
+	bgManager->Begin();
+
+	int32 lineNumber = 0;
+	int32 commandCount = 0;
+	std::vector<background_edit> batchEdits;
+	std::string line;
+	while (std::getline(*input, line)) {
+		lineNumber++;
+
+		std::vector<std::string> args;
+		if (!_split_line(line, args)) {
+			std::cerr << "Error: unmatched quote on line " << lineNumber << ", no changes were written" << std::endl;
+			return 1;
+		}
+
+		if (args.empty())
+			continue;
+
+		args.insert(args.begin(), "bgswitch");
+		std::vector<char*> argv;
+		for (std::string& arg : args)
+			argv.push_back(arg.data());
+		argv.push_back(nullptr);
+
+		if (_run_command(args.size(), argv.data(), bgManager, &batchEdits) != 0) {
+			std::cerr << "Error: command on line " << lineNumber << " failed, no changes were written" << std::endl;
+			return 1;
+		}
+
+		commandCount++;
+	}
+
+	bigtime_t flushTime = system_time();
+
+	if (client) {
+		// the local changes were only needed to check the commands and list the results
+		if (!batchEdits.empty() && _send_edits(batchEdits.data(), batchEdits.size()) != B_OK)
+			return 1;
+		if (sBatchCompact && _send_compact(nullptr) != B_OK)
+			return 1;
+	} else if (bgManager->Commit() != B_OK)
+		return 1;
+
+	bigtime_t endTime = system_time();
+
+	// stderr is left alone otherwise, scripts may treat anything written to it as a failure
+	if (!sShowTimings && !verbose)
+		return 0;
+
+	std::cerr << "Ran " << commandCount << " commands in " << (endTime - startTime) / 1000.0 << "ms"
+		<< " (commands: " << (flushTime - startTime) / 1000.0 << "ms"
+		<< ", flush: " << (endTime - flushTime) / 1000.0 << "ms)" << std::endl;
+
+	return 0;
+}
+
+
+int
+_run_command(int argc, char** argv, BackgroundManager*& bgManager, std::vector<background_edit>* batchEdits)
 {
 	argparse::ArgumentParser programParser(argv[0], "1.0", argparse::default_arguments::help);
 	programParser.add_description("Adjust workspace background settings");
@@ -56,8 +694,7 @@ main(int argc, char** argv)
 		.default_value(false)
 		.implicit_value(true);
 	programParser.add_argument("-w", "--workspace")
-		.help("The workspace # to modify, otherwise use the current workspace (ex. -w 2)")
-		.scan<'i', int32>();
+		.help("The workspace #s to modify, otherwise use the current workspace (ex. -w 2 or -w 2,5,9-12)");
 	programParser.add_argument("-v", "--verbose")
 		.help("Print extra output to screen")
 		.default_value(false)
@@ -66,9 +703,22 @@ main(int argc, char** argv)
 		.help("Print debugging output to screen")
 		.default_value(false)
 		.implicit_value(true);
+	programParser.add_argument("--direct")
+		.help("Change the settings directly even if Wallrus is running")
+		.default_value(false)
+		.implicit_value(true);
+	programParser.add_argument("-b", "--batch")
+		.help("Run one command per line from a file, or - for stdin, and write the changes once at the end");
+	programParser.add_argument("--timings")
+		.help("Print how long each phase took in microseconds")
+		.default_value(false)
+		.implicit_value(true);
 
 	argparse::ArgumentParser listParser("list", "1.0", argparse::default_arguments::help);
 	listParser.add_description("List background information");
+	listParser.add_argument("--format")
+		.help("Output format, one of text/json/tsv (ex. --format=json)")
+		.default_value(std::string{"text"});
 
 	argparse::ArgumentParser setParser("set", "1.0", argparse::default_arguments::help);
 	setParser.add_description("Set workspace background options");
@@ -95,6 +745,9 @@ main(int argc, char** argv)
 		.help("Set background RGB color, separated by a space (ex. -c 20 100 255)")
 		.scan<'u', uint8>()
 		.nargs(3);
+	setParser.add_argument("--map")
+		.help("Set a different image file for each workspace, instead of using -f and -w (ex. --map 1=/a.jpg 2=/b.jpg)")
+		.nargs(argparse::nargs_pattern::at_least_one);
 
 	argparse::ArgumentParser clearParser("clear", "1.0", argparse::default_arguments::help);
 	clearParser.add_description("Make background empty (same effect as: set -f \"\")");
@@ -102,10 +755,58 @@ main(int argc, char** argv)
 	argparse::ArgumentParser resetParser("reset", "1.0", argparse::default_arguments::help);
 	resetParser.add_description("Reset background to global default");
 
+	argparse::ArgumentParser compactParser("compact", "1.0", argparse::default_arguments::help);
+	compactParser.add_description("Merge workspaces with identical settings into shared entries");
+
+	argparse::ArgumentParser watchParser("watch", "1.0", argparse::default_arguments::help);
+	watchParser.add_description("Print the workspaces whose settings change until interrupted");
+	watchParser.add_argument("--format")
+		.help("Output format, one of text/json/tsv (ex. --format=json)")
+		.default_value(std::string{"text"});
+	watchParser.add_argument("--colors")
+		.help("Also check the background colors every second, their changes aren't announced")
+		.default_value(false)
+		.implicit_value(true);
+
+	argparse::ArgumentParser exportParser("export", "1.0", argparse::default_arguments::help);
+	exportParser.add_description("Save the settings of all workspaces and the desktop colors to a snapshot file");
+	exportParser.add_argument("file")
+		.help("Path to the snapshot file, or - for stdout");
+
+	argparse::ArgumentParser importParser("import", "1.0", argparse::default_arguments::help);
+	importParser.add_description("Replace the settings of all workspaces and the desktop colors with a snapshot file");
+	importParser.add_argument("file")
+		.help("Path to the snapshot file, or - for stdin");
+
+	argparse::ArgumentParser profileParser("profile", "1.0", argparse::default_arguments::help);
+	profileParser.add_description("Save and apply named snapshots of all workspaces");
+
+	argparse::ArgumentParser profileSaveParser("save", "1.0", argparse::default_arguments::help);
+	profileSaveParser.add_description("Save the current settings as a profile, replacing one with the same name");
+	profileSaveParser.add_argument("name")
+		.help("Name of the profile");
+
+	argparse::ArgumentParser profileApplyParser("apply", "1.0", argparse::default_arguments::help);
+	profileApplyParser.add_description("Replace the current settings with a profile");
+	profileApplyParser.add_argument("name")
+		.help("Name of the profile");
+
+	argparse::ArgumentParser profileListParser("list", "1.0", argparse::default_arguments::help);
+	profileListParser.add_description("List the saved profiles");
+
+	profileParser.add_subparser(profileSaveParser);
+	profileParser.add_subparser(profileApplyParser);
+	profileParser.add_subparser(profileListParser);
+
 	programParser.add_subparser(listParser);
 	programParser.add_subparser(setParser);
 	programParser.add_subparser(clearParser);
 	programParser.add_subparser(resetParser);
+	programParser.add_subparser(compactParser);
+	programParser.add_subparser(watchParser);
+	programParser.add_subparser(exportParser);
+	programParser.add_subparser(importParser);
+	programParser.add_subparser(profileParser);
 
 	try {
 		programParser.parse_args(argc, argv);
@@ -115,46 +816,120 @@ main(int argc, char** argv)
 		return 1;
 	}
 
-	BackgroundManager bgManager(nullptr);
+	if (programParser["timings"] == true) {
+		if (batchEdits != nullptr) {
+			std::cerr << "Error: --timings can not be used inside of a batch" << std::endl;
+			return 1;
+		}
+		sShowTimings = true;
+	}
 
-	if (bgManager.InitCheck() != B_OK)
-		return 1;
+	// let a running Wallrus make the changes so there is only one writer
+	bool client = programParser["direct"] == false && be_roster->IsRunning(kWallrusSignature);
 
-	if (programParser["debug"] == true)
-		bgManager.PrintToStream();
+	if (programParser.is_used("batch")) {
+		if (batchEdits != nullptr) {
+			std::cerr << "Error: -b/--batch can not be used inside of a batch" << std::endl;
+			return 1;
+		}
+		if (programParser.is_subcommand_used("list") || programParser.is_subcommand_used("set")
+			|| programParser.is_subcommand_used("clear") || programParser.is_subcommand_used("reset")
+			|| programParser.is_subcommand_used("compact") || programParser.is_subcommand_used("watch")
+			|| programParser.is_subcommand_used("export") || programParser.is_subcommand_used("import")
+			|| programParser.is_subcommand_used("profile")) {
+			std::cerr << "Error: commands must be given in the batch file when using -b/--batch" << std::endl;
+			return 1;
+		}
 
-	// a BApplication is needed for count_workspaces(), doesn't need to be running
-	BApplication App("application/x-vnd.cpr.bgswitch");
+		return _run_batch(programParser.get<std::string>("batch"), bgManager, client,
+			programParser["verbose"] == true);
+	}
+
+	// only reading the settings needs them when Wallrus is running
+	bool needManager = !client || programParser["debug"] == true || programParser.is_subcommand_used("list")
+		|| programParser.is_subcommand_used("watch")
+		|| programParser.is_subcommand_used("export")
+		|| (programParser.is_subcommand_used("profile") && profileParser.is_subcommand_used("save"));
+
+	if (bgManager == nullptr && needManager) {
+		bgManager = new BackgroundManager(nullptr, &sTimings);
+		if (bgManager->InitCheck() != B_OK)
+			return 1;
+	}
+
+	if (programParser["debug"] == true)
+		bgManager->PrintToStream();
 
-	int32 maxWorkspace = count_workspaces();
-	int32 workspace = 1;
+	int32 maxWorkspace;
+	{
+		PhaseTimer timer(&sTimings, "count_workspaces");
+		maxWorkspace = count_workspaces();
+	}
+	// bit N is workspace N, the same as background_edit::workspaces
+	uint64 workspaces = 0;
 
 	if (programParser["all"] == false) {
 		if (programParser.is_used("workspace")) {
-			workspace = programParser.get<int32>("workspace");
-			_check_workspace(workspace);
+			if (_parse_workspaces(programParser.get<std::string>("workspace"), maxWorkspace, workspaces) != B_OK)
+				return 1;
 		} else
-			workspace = current_workspace() + 1;
-
-		// if we're net setting all workspaces then set them equal so the for loops below only run one loop
-		maxWorkspace = workspace;
+			workspaces = (uint64)1 << (current_workspace() + 1);
 	} else if (programParser.is_used("workspace")) {
 		std::cerr << "Error: only one of -w/--workspace and -a/--all may be used" << std::endl;
 		std::cerr << programParser << std::endl;
 		return 1;
+	} else {
+		// every workspace except the global default
+		workspaces = (((uint64)1 << maxWorkspace) - 1) << 1;
 	}
 
+	std::vector<int32> workspaceList = _workspace_list(workspaces);
+
 	bool verbose = (programParser["verbose"] == true);
 
 	if (programParser.is_subcommand_used("list")) {
 		// show the global defaults only when listing all in verbose mode
 		if (verbose && programParser.is_used("all"))
-			workspace = 0;
+			workspaceList = _workspace_list(workspaces | 1);
+
+		std::string format = listParser.get<std::string>("format");
+		if (format != "text" && format != "json" && format != "tsv") {
+			std::cerr << "Error: invalid format, must be one of text/json/tsv" << std::endl;
+			std::cerr << listParser << std::endl;
+			return 1;
+		}
 
-		for (int32 x = workspace; x <= maxWorkspace; x++)
-			bgManager.PrintBackgroundToStream(x, verbose);
+		workspace_info info[33];
+		if (bgManager->GetAllWorkspaceInfo(info) != B_OK)
+			return 1;
 
-		return 0;
+		if (format == "text") {
+			for (int32 x : workspaceList)
+				BackgroundManager::PrintBackgroundToStream(x, info[x], verbose);
+
+			return 0;
+		}
+
+		// machine readable output always includes the global defaults when listing all
+		if (programParser.is_used("all"))
+			workspaceList = _workspace_list(workspaces | 1);
+
+		std::string output;
+		if (format == "json") {
+			output += '[';
+			for (int32 x : workspaceList) {
+				if (x != workspaceList.front())
+					output += ',';
+				_append_json(output, x, info[x]);
+			}
+			output += "]\n";
+		} else {
+			output += kTsvHeader;
+			for (int32 x : workspaceList)
+				_append_tsv(output, x, info[x]);
+		}
+
+		return _write_output(output) == B_OK ? 0 : 1;
 	} else if (programParser.is_subcommand_used("set")) {
 		// option sanity checking
 		if (setParser.is_used("text") && setParser.is_used("notext")) {
@@ -166,114 +941,372 @@ main(int argc, char** argv)
 		// more option sanity checking
 		if (!setParser.is_used("file") && !setParser.is_used("mode")
 			&& !setParser.is_used("text") && !setParser.is_used("notext")
-			&& !setParser.is_used("offset") && !setParser.is_used("color")) {
-			std::cerr << "Error: must specify one of the file/mode/text/notext/offset/color options" << std::endl;
+			&& !setParser.is_used("offset") && !setParser.is_used("color")
+			&& !setParser.is_used("map")) {
+			std::cerr << "Error: must specify one of the file/mode/text/notext/offset/color/map options" << std::endl;
 			std::cerr << setParser << std::endl;
 			return 1;
 		}
 
-		for (int32 x = workspace; x <= maxWorkspace; x++) {
-			if (setParser.is_used("file")) {
-				std::string imagePath = setParser.get<std::string>("file");
+		std::vector<background_edit> edits;
+
+		if (setParser.is_used("map")) {
+			// the mapping decides which workspaces are changed
+			if (setParser.is_used("file") || programParser.is_used("workspace") || programParser["all"] == true) {
+				std::cerr << "Error: --map can not be used with -f/--file, -w/--workspace or -a/--all" << std::endl;
+				std::cerr << setParser << std::endl;
+				return 1;
+			}
+
+			workspaces = 0;
+			for (const std::string& mapping : setParser.get<std::vector<std::string>>("map")) {
+				// without a separator the workspace number is empty and fails to parse
+				size_t separator = mapping.find('=');
+				if (separator == std::string::npos)
+					separator = 0;
+
+				int32 mapWorkspace = -1;
+				std::from_chars_result result = std::from_chars(mapping.data(), mapping.data() + separator, mapWorkspace);
+				if (result.ec != std::errc() || result.ptr != mapping.data() + separator
+					|| mapWorkspace < 0 || mapWorkspace > maxWorkspace) {
+					std::cerr << "Error: invalid mapping " << mapping << ", must be workspace=file" << std::endl;
+					return 1;
+				}
+
+				if ((workspaces & ((uint64)1 << mapWorkspace)) != 0) {
+					std::cerr << "Error: workspace " << mapWorkspace << " is mapped more than once" << std::endl;
+					return 1;
+				}
+
+				std::string imagePath = mapping.substr(separator + 1);
 				if (verbose)
-					std::cout << "Setting workspace " << x << " background to "
+					std::cout << "Setting workspace " << mapWorkspace << " background to "
 							<< (imagePath.length() == 0 ? "<none>" : imagePath)
 							<< std::endl;
 
-				if (bgManager.SetBackground(imagePath.c_str(), x) != B_OK)
-					return 1;
+				background_edit edit(kEditImage, (uint64)1 << mapWorkspace);
+				edit.path = imagePath.c_str();
+				edits.push_back(edit);
+
+				workspaces |= (uint64)1 << mapWorkspace;
 			}
 
-			if (setParser.is_used("text")) {
-				if (verbose)
-					std::cout << "Enabling text outline for workspace " << x << std::endl;
-				if (bgManager.SetOutline(true, x) != B_OK)
-					return 1;
+			// the other options apply to every mapped workspace
+			workspaceList = _workspace_list(workspaces);
+		}
+
+		if (setParser.is_used("file")) {
+			std::string imagePath = setParser.get<std::string>("file");
+			if (verbose) {
+				for (int32 x : workspaceList)
+					std::cout << "Setting workspace " << x << " background to "
+							<< (imagePath.length() == 0 ? "<none>" : imagePath)
+							<< std::endl;
 			}
 
-			if (setParser.is_used("notext")) {
-				if (verbose)
-					std::cout << "Disabling text outline for workspace " << x << std::endl;
-				if (bgManager.SetOutline(false, x) != B_OK)
-					return 1;
+			background_edit edit(kEditImage, workspaces);
+			edit.path = imagePath.c_str();
+			edits.push_back(edit);
+		}
+
+		if (setParser.is_used("text") || setParser.is_used("notext")) {
+			bool outline = setParser.is_used("text");
+			if (verbose) {
+				for (int32 x : workspaceList)
+					std::cout << (outline ? "Enabling" : "Disabling") << " text outline for workspace " << x << std::endl;
 			}
 
-			if (setParser.is_used("offset")) {
-				auto offset = setParser.get<std::vector<int32>>("offset");
-				if (verbose)
+			background_edit edit(kEditOutline, workspaces);
+			edit.outline = outline;
+			edits.push_back(edit);
+		}
+
+		if (setParser.is_used("offset")) {
+			auto offset = setParser.get<std::vector<int32>>("offset");
+			if (verbose) {
+				for (int32 x : workspaceList)
 					std::cout << "Setting X/Y offset to " << offset[0] << "/" << offset[1] << " for workspace " << x << std::endl;
-				if (bgManager.SetOffset(offset[0], offset[1], x) != B_OK)
-					return 1;
 			}
 
-			if (setParser.is_used("mode")) {
-				int32 mode = 0;
-
-				switch (setParser.get<uint8>("mode")) {
-					case 1:
-						if (verbose)
-							std::cout << "Setting placement mode to <manual> for workspace " << x << std::endl;
-						mode = B_BACKGROUND_MODE_USE_ORIGIN;
-						break;
-					case 2:
-						if (verbose)
-							std::cout << "Setting placement mode to <centered> for workspace " << x << std::endl;
-						mode = B_BACKGROUND_MODE_CENTERED;
-						break;
-					case 3:
-						if (verbose)
-							std::cout << "Setting placement mode to <scaled> for workspace " << x << std::endl;
-						mode = B_BACKGROUND_MODE_SCALED;
-						break;
-					case 4:
-						if (verbose)
-							std::cout << "Setting placement mode to <tiled> for workspace " << x << std::endl;
-						mode = B_BACKGROUND_MODE_TILED;
-						break;
-					default:
-						std::cerr << "Error: invalid placement mode, must be one of 1/2/3/4" << std::endl;
-						std::cerr << setParser << std::endl;
-						return 1;
-				}
+			background_edit edit(kEditOffset, workspaces);
+			edit.offset = BPoint(offset[0], offset[1]);
+			edits.push_back(edit);
+		}
+
+		if (setParser.is_used("mode")) {
+			background_edit edit(kEditMode, workspaces);
+			const char* modeName = nullptr;
 
-				if (bgManager.SetPlacement(mode, x) != B_OK)
+			switch (setParser.get<uint8>("mode")) {
+				case 1:
+					modeName = "manual";
+					edit.mode = B_BACKGROUND_MODE_USE_ORIGIN;
+					break;
+				case 2:
+					modeName = "centered";
+					edit.mode = B_BACKGROUND_MODE_CENTERED;
+					break;
+				case 3:
+					modeName = "scaled";
+					edit.mode = B_BACKGROUND_MODE_SCALED;
+					break;
+				case 4:
+					modeName = "tiled";
+					edit.mode = B_BACKGROUND_MODE_TILED;
+					break;
+				default:
+					std::cerr << "Error: invalid placement mode, must be one of 1/2/3/4" << std::endl;
+					std::cerr << setParser << std::endl;
 					return 1;
 			}
 
-			if (setParser.is_used("color")) {
-				auto colorVec = setParser.get<std::vector<uint8>>("color");
-				if (verbose)
+			if (verbose) {
+				for (int32 x : workspaceList)
+					std::cout << "Setting placement mode to <" << modeName << "> for workspace " << x << std::endl;
+			}
+
+			edits.push_back(edit);
+		}
+
+		if (setParser.is_used("color")) {
+			auto colorVec = setParser.get<std::vector<uint8>>("color");
+			if (verbose) {
+				for (int32 x : workspaceList)
 					std::cout << "Setting RGB color to {r:" << +colorVec[0] << ",g:" << +colorVec[1] << ",b:" << +colorVec[2] << "} for workspace " << x << std::endl;
-				if (bgManager.SetColor((rgb_color){colorVec[0], colorVec[1], colorVec[2], 255}, x) != B_OK)
-					return 1;
 			}
+
+			background_edit edit(kEditColor, workspaces);
+			edit.color = (rgb_color){colorVec[0], colorVec[1], colorVec[2], 255};
+			edits.push_back(edit);
 		}
 
-		bgManager.Flush();
-		return 0;
+		return _apply_edits(bgManager, edits.data(), edits.size(), batchEdits);
 	} else if (programParser.is_subcommand_used("clear") || programParser.is_subcommand_used("reset")) {
-		if (workspace == 0 && programParser.is_subcommand_used("clear")) {
+		bool reset = programParser.is_subcommand_used("reset");
+		if ((workspaces & 1) != 0 && reset) {
 			std::cerr << "Error: unable to reset the global workspace" << std::endl;
 			return 1;
 		}
 
-		for (int32 x = workspace; x <= maxWorkspace; x++) {
-			if (programParser.is_subcommand_used("reset")) {
-				if (verbose)
+		if (verbose) {
+			for (int32 x : workspaceList) {
+				if (reset)
 					std::cout << "Resetting workspace " << x << " to global default" << std::endl;
-				bgManager.ResetWorkspace(x);
-			} else {
-				if (verbose)
+				else
 					std::cout << "Clearing workspace " << x << std::endl;
-				bgManager.SetBackground(nullptr, x);
 			}
 		}
 
-		bgManager.Flush();
+		background_edit edit(reset ? kEditReset : kEditImage, workspaces);
+
+		return _apply_edits(bgManager, &edit, 1, batchEdits);
+	} else if (programParser.is_subcommand_used("compact")) {
+		// the workspace options don't apply, compacting always covers the whole message
+		int32 merged = 0;
+		if (batchEdits == nullptr && client) {
+			// Wallrus is running and writes the settings
+			if (_send_compact(&merged) != B_OK)
+				return 1;
+
+			if (verbose)
+				std::cout << "Merged " << merged << " duplicate entries" << std::endl;
+			return 0;
+		}
+
+		if (bgManager->Compact(&merged) != B_OK)
+			return 1;
+
+		if (verbose)
+			std::cout << "Merged " << merged << " duplicate entries" << std::endl;
+
+		// written together with the rest of the batch, by Wallrus if it is running
+		if (batchEdits != nullptr) {
+			sBatchCompact = true;
+			return 0;
+		}
+
+		// nothing to write, don't make Tracker reload the backgrounds
+		if (merged == 0)
+			return 0;
+
+		return bgManager->Flush() == B_OK ? 0 : 1;
+	} else if (programParser.is_subcommand_used("watch")) {
+		if (batchEdits != nullptr) {
+			std::cerr << "Error: watch can not be used inside of a batch" << std::endl;
+			return 1;
+		}
+
+		std::string format = watchParser.get<std::string>("format");
+		if (format != "text" && format != "json" && format != "tsv") {
+			std::cerr << "Error: invalid format, must be one of text/json/tsv" << std::endl;
+			std::cerr << watchParser << std::endl;
+			return 1;
+		}
+
+		// a change to the global defaults is reported on its own when watching all
+		if (programParser.is_used("all"))
+			workspaceList = _workspace_list(workspaces | 1);
+
+		// the same folder BackgroundManager reads from
+		BPath desktopPath;
+		if (find_directory(B_DESKTOP_DIRECTORY, &desktopPath) != B_OK) {
+			std::cerr << "Error: unable to find B_DESKTOP_DIRECTORY" << std::endl;
+			return 1;
+		}
+
+		node_ref desktopRef;
+		if (BNode(desktopPath.Path()).GetNodeRef(&desktopRef) != B_OK) {
+			std::cerr << "Error: unable to get node_ref for the Desktop folder" << std::endl;
+			return 1;
+		}
+
+		WatchHandler* handler = new WatchHandler(bgManager, workspaceList, format, verbose);
+		be_app->Lock();
+		be_app->AddHandler(handler);
+		be_app->Unlock();
+
+		if (watch_node(&desktopRef, B_WATCH_ATTR, handler) != B_OK) {
+			std::cerr << "Error: unable to start node monitoring" << std::endl;
+			return 1;
+		}
+
+		BMessageRunner* colorsRunner = nullptr;
+		if (watchParser.get<bool>("--colors")) {
+			BMessage colorsMessage(kWatchColorsWhat);
+			colorsRunner = new BMessageRunner(BMessenger(handler), &colorsMessage, kWatchColorsInterval);
+		}
+
+		if (format == "tsv")
+			_write_output(kTsvHeader);
+
+		be_app->Run();
+		delete colorsRunner;
+
 		return 0;
+	} else if (programParser.is_subcommand_used("export")) {
+		// snapshots always cover every workspace, the workspace options don't apply
+		if (batchEdits != nullptr) {
+			std::cerr << "Error: export can not be used inside of a batch" << std::endl;
+			return 1;
+		}
+
+		std::vector<char> snapshot;
+		if (bgManager->ExportSnapshot(snapshot) != B_OK)
+			return 1;
+
+		return _write_snapshot(exportParser.get<std::string>("file"), snapshot) == B_OK ? 0 : 1;
+	} else if (programParser.is_subcommand_used("import")) {
+		if (batchEdits != nullptr) {
+			std::cerr << "Error: import can not be used inside of a batch" << std::endl;
+			return 1;
+		}
+
+		std::vector<char> snapshot;
+		if (_read_snapshot(importParser.get<std::string>("file"), snapshot) != B_OK)
+			return 1;
+
+		if (client)
+			return _send_snapshot(snapshot) == B_OK ? 0 : 1;
+
+		return bgManager->ImportSnapshot(snapshot.data(), snapshot.size()) == B_OK ? 0 : 1;
+	} else if (programParser.is_subcommand_used("profile")) {
+		if (batchEdits != nullptr) {
+			std::cerr << "Error: profile can not be used inside of a batch" << std::endl;
+			return 1;
+		}
+
+		if (profileParser.is_subcommand_used("list")) {
+			BPath profilesPath;
+			if (_profile_directory(profilesPath, false) != B_OK)
+				return 1;
+
+			// nothing has been saved yet
+			BDirectory directory(profilesPath.Path());
+			if (directory.InitCheck() != B_OK)
+				return 0;
+
+			std::vector<std::string> names;
+			BEntry entry;
+			while (directory.GetNextEntry(&entry) == B_OK) {
+				if (entry.IsFile())
+					names.push_back(BPath(&entry).Leaf());
+			}
+			std::sort(names.begin(), names.end());
+
+			std::string output;
+			for (const std::string& name : names)
+				output += name + "\n";
+
+			return _write_output(output) == B_OK ? 0 : 1;
+		}
+
+		if (profileParser.is_subcommand_used("save")) {
+			BPath profilePath;
+			if (_profile_path(profileSaveParser.get<std::string>("name"), profilePath, true) != B_OK)
+				return 1;
+
+			std::vector<char> snapshot;
+			if (bgManager->ExportSnapshot(snapshot) != B_OK)
+				return 1;
+
+			if (_write_snapshot(profilePath.Path(), snapshot) != B_OK)
+				return 1;
+
+			if (verbose)
+				std::cout << "Saved profile to " << profilePath.Path() << std::endl;
+
+			return 0;
+		}
+
+		if (profileParser.is_subcommand_used("apply")) {
+			// the profile is already flattened, applying it is a check and a single write
+			std::string name = profileApplyParser.get<std::string>("name");
+			BPath profilePath;
+			if (_profile_path(name, profilePath, false) != B_OK)
+				return 1;
+
+			if (!BEntry(profilePath.Path()).Exists()) {
+				std::cerr << "Error: there is no profile named " << name << std::endl;
+				return 1;
+			}
+
+			std::vector<char> snapshot;
+			if (_read_snapshot(profilePath.Path(), snapshot) != B_OK)
+				return 1;
+
+			if (client)
+				return _send_snapshot(snapshot) == B_OK ? 0 : 1;
+
+			return bgManager->ImportSnapshot(snapshot.data(), snapshot.size()) == B_OK ? 0 : 1;
+		}
+
+		std::cerr << profileParser << std::endl;
+		return 1;
 	} else if (programParser["debug"] != true)
 		// only print the help if we don't have a command and aren't asked to dump the message
 		std::cout << programParser << std::endl;
 
 	return 1;
 }
+
+
+int
+main(int argc, char** argv)
+{
+	bigtime_t appStart = system_time();
+	// a BApplication is needed for count_workspaces(), doesn't need to be running
+	BApplication App("application/x-vnd.cpr.bgswitch");
+	sTimings.Add("BApplication", system_time() - appStart);
+
+	BackgroundManager* bgManager = nullptr;
+	int result = _run_command(argc, argv, bgManager, nullptr);
+	delete bgManager;
+
+	if (sShowTimings) {
+		for (int32 x = 0; x < sTimings.CountPhases(); x++)
+			std::cerr << sTimings.NameAt(x) << ": " << sTimings.DurationAt(x) << "us" << std::endl;
+		std::cerr << "total: " << sTimings.TotalDuration() << "us" << std::endl;
+	}
+
+	return result;
+}
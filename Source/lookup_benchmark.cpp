@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+// Compares finding the message index of every workspace by scanning the
+// B_BACKGROUND_WORKSPACES entries, as _FindWorkspaceIndex() used to, with the
+// table kept by BackgroundSet.  The fixture has a custom index for all 32 workspaces.
+//
+// usage: lookup_benchmark [rounds]
+
+
+#include "BackgroundSet.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+static const uint32 kMessageFormat = 0x31464d48;		// '1FMH'
+static const uint16 kFieldValid = 0x0001;
+static const uint16 kFieldFixedSize = 0x0002;
+static const int32 kHashTableSize = 5;
+
+// read once per round so the compiler can't hoist the lookups out of the loops
+static volatile int32 sFirstWorkspace = 1;
+
+
+struct fixture_field {
+	const char* name;
+	type_code type;
+	bool fixedSize;
+	std::vector<std::string> items;
+};
+
+
+template<typename T>
+static void
+_append(std::string& data, T value)
+{
+	// the benchmark only runs on little endian hosts, like the fixture it writes
+	data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+
+static std::string
+_item(const void* value, size_t size)
+{
+	return std::string(static_cast<const char*>(value), size);
+}
+
+
+// a flattened message with the global default and one index per workspace
+static std::string
+_build_fixture()
+{
+	std::vector<fixture_field> fields = {
+		{B_BACKGROUND_WORKSPACES, B_INT32_TYPE, true, {}},
+		{B_BACKGROUND_IMAGE, B_STRING_TYPE, false, {}},
+		{B_BACKGROUND_MODE, B_INT32_TYPE, true, {}},
+		{B_BACKGROUND_ORIGIN, B_POINT_TYPE, true, {}},
+		{B_BACKGROUND_ERASE_TEXT, B_BOOL_TYPE, true, {}},
+		{BACKGROUND_SET, B_INT32_TYPE, true, {}}
+	};
+
+	for (int32 index = 0; index <= 32; index++) {
+		// index 0 is the global default which no workspace follows
+		uint32 workspaces = index == 0 ? 0 : 1u << (index - 1);
+		int32 mode = B_BACKGROUND_MODE_SCALED;
+		background_origin origin = {(float)index, (float)index};
+		bool erase = true;
+		int32 setFlag = 0;
+		std::string path = "/boot/home/Pictures/workspace" + std::to_string(index) + ".jpg";
+
+		fields[0].items.push_back(_item(&workspaces, sizeof(workspaces)));
+		fields[1].items.push_back(std::string(path.c_str(), path.length() + 1));
+		fields[2].items.push_back(_item(&mode, sizeof(mode)));
+		fields[3].items.push_back(_item(&origin, sizeof(origin)));
+		fields[4].items.push_back(_item(&erase, sizeof(erase)));
+		fields[5].items.push_back(_item(&setFlag, sizeof(setFlag)));
+	}
+
+	std::string headers;
+	std::string data;
+	for (const fixture_field& field : fields) {
+		uint32 offset = data.length();
+		std::string name(field.name, strlen(field.name) + 1);
+		std::string body;
+		for (const std::string& item : field.items) {
+			if (!field.fixedSize)
+				_append<uint32>(body, item.length());
+			body += item;
+		}
+		data += name + body;
+
+		_append<uint16>(headers, field.fixedSize ? kFieldValid | kFieldFixedSize : kFieldValid);
+		_append<uint16>(headers, name.length());
+		_append<uint32>(headers, field.type);
+		_append<uint32>(headers, field.items.size());
+		_append<uint32>(headers, body.length());
+		_append<uint32>(headers, offset);
+		_append<int32>(headers, -1);
+	}
+
+	std::string message;
+	_append<uint32>(message, kMessageFormat);
+	_append<uint32>(message, 0);
+	_append<uint32>(message, 1);
+	for (int32 x = 0; x < 5; x++)
+		_append<int32>(message, -1);
+	_append<uint32>(message, data.length());
+	_append<uint32>(message, fields.size());
+	_append<uint32>(message, kHashTableSize);
+	for (int32 x = 0; x < kHashTableSize; x++)
+		_append<int32>(message, -1);
+
+	return message + headers + data;
+}
+
+
+// the previous lookup, the first index after the global default with the workspace bit set
+static int32
+_scan_index(const BackgroundInfoReader& reader, int32 workspace)
+{
+	uint32 workspaceBit = 1u << (workspace - 1);
+	int32 count = reader.Workspaces().CountItems();
+	for (int32 x = 1; x < count; x++) {
+		if ((reader.Workspaces().ItemAt(x) & workspaceBit) != 0)
+			return x;
+	}
+
+	return -1;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int32 rounds = argc > 1 ? atol(argv[1]) : 1000000;
+	if (rounds <= 0) {
+		fprintf(stderr, "Error: invalid number of rounds\n");
+		return 1;
+	}
+
+	std::string fixture = _build_fixture();
+	BackgroundInfoReader reader(fixture.data(), fixture.length());
+	BackgroundSet backgroundSet;
+	if (reader.InitCheck() != B_OK || backgroundSet.SetTo(reader) != B_OK
+		|| backgroundSet.CountIndices() != 33) {
+		fprintf(stderr, "Error: unable to parse the fixture\n");
+		return 1;
+	}
+
+	// both have to agree before their timings mean anything
+	for (int32 workspace = 1; workspace <= 32; workspace++) {
+		if (_scan_index(reader, workspace) != backgroundSet.IndexFor(workspace)) {
+			fprintf(stderr, "Error: lookups differ for workspace %d\n", (int)workspace);
+			return 1;
+		}
+	}
+
+	// summed up and printed so the lookups can't be optimized away
+	int64 scanSum = 0;
+	auto scanStart = std::chrono::steady_clock::now();
+	for (int32 round = 0; round < rounds; round++) {
+		for (int32 workspace = sFirstWorkspace; workspace <= 32; workspace++)
+			scanSum += _scan_index(reader, workspace);
+	}
+	auto scanEnd = std::chrono::steady_clock::now();
+
+	int64 tableSum = 0;
+	for (int32 round = 0; round < rounds; round++) {
+		for (int32 workspace = sFirstWorkspace; workspace <= 32; workspace++)
+			tableSum += backgroundSet.IndexFor(workspace);
+	}
+	auto tableEnd = std::chrono::steady_clock::now();
+
+	double lookups = (double)rounds * 32;
+	double scanTime = std::chrono::duration<double, std::nano>(scanEnd - scanStart).count();
+	double tableTime = std::chrono::duration<double, std::nano>(tableEnd - scanEnd).count();
+
+	printf("%d rounds of 32 workspaces, fixture %zu bytes\n", (int)rounds, fixture.length());
+	printf("scan:  %8.2f ns per lookup (%lld)\n", scanTime / lookups, (long long)scanSum);
+	printf("table: %8.2f ns per lookup (%lld)\n", tableTime / lookups, (long long)tableSum);
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2024 Chris Roberts
+
+// Creates a tree of empty files in a temporary folder and lists it with a simple
+// loop which builds every path and calls stat() on it, like the scanner used to,
+// and with DirectoryScanner using one thread and all threads.  The tree is removed
+// afterwards.  Every 50th entry is a dot file, half of the folders are nested.
+//
+// The scanner runs with and without the entry types from readdir().  Haiku has no
+// d_type, so only the second one shows what the scanner does there.
+//
+// usage: scan_benchmark [entries] [parent folder]
+
+
+#include "DirectoryScanner.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+
+static const int32 kEntriesPerFolder = 1000;
+
+
+static bool
+_create_tree(const std::string& root, int32 entries)
+{
+	int32 folderCount = (entries + kEntriesPerFolder - 1) / kEntriesPerFolder;
+	for (int32 folder = 0; folder < folderCount; folder++) {
+		std::string path = root + "/folder" + std::to_string(folder);
+		if (mkdir(path.c_str(), 0755) != 0)
+			return false;
+
+		if (folder % 2 == 1) {
+			path += "/nested";
+			if (mkdir(path.c_str(), 0755) != 0)
+				return false;
+		}
+
+		for (int32 x = 0; x < kEntriesPerFolder && folder * kEntriesPerFolder + x < entries; x++) {
+			char name[32];
+			snprintf(name, sizeof(name), x % 50 == 0 ? ".hidden%05d" : "image%05d.jpg", (int)x);
+			int fd = open((path + "/" + name).c_str(), O_CREAT | O_WRONLY, 0644);
+			if (fd < 0)
+				return false;
+			close(fd);
+		}
+	}
+
+	return true;
+}
+
+
+// the previous way of listing a folder, a full path and a stat() for every entry
+static void
+_scan_per_entry(const std::string& path, std::vector<std::string>& files)
+{
+	DIR* dir = opendir(path.c_str());
+	if (dir == nullptr)
+		return;
+
+	struct dirent* dirEntry;
+	while ((dirEntry = readdir(dir)) != nullptr) {
+		const char* name = dirEntry->d_name;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			continue;
+
+		std::string childPath = path + "/" + name;
+		struct stat childStat;
+		if (stat(childPath.c_str(), &childStat) != 0)
+			continue;
+
+		if (S_ISDIR(childStat.st_mode))
+			_scan_per_entry(childPath, files);
+		else if (S_ISREG(childStat.st_mode) && name[0] != '.')
+			files.push_back(std::move(childPath));
+	}
+
+	closedir(dir);
+}
+
+
+static double
+_milliseconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int32 entries = argc > 1 ? atol(argv[1]) : 1000000;
+	std::string parent = argc > 2 ? argv[2] : "/tmp";
+	if (entries <= 0) {
+		fprintf(stderr, "Error: invalid number of entries\n");
+		return 1;
+	}
+
+	std::string pattern = parent + "/scan_benchmark.XXXXXX";
+	std::vector<char> rootBuffer(pattern.c_str(), pattern.c_str() + pattern.length() + 1);
+	if (mkdtemp(rootBuffer.data()) == nullptr) {
+		fprintf(stderr, "Error: unable to create a folder in %s\n", parent.c_str());
+		return 1;
+	}
+	std::string root = rootBuffer.data();
+
+	auto start = std::chrono::steady_clock::now();
+	if (!_create_tree(root, entries)) {
+		fprintf(stderr, "Error: unable to create the tree in %s\n", root.c_str());
+		std::filesystem::remove_all(root);
+		return 1;
+	}
+	printf("created %d entries in %.1fms\n", (int)entries, _milliseconds_since(start));
+
+	std::vector<std::string> perEntryFiles;
+	start = std::chrono::steady_clock::now();
+	_scan_per_entry(root, perEntryFiles);
+	printf("per entry stat():                    %8.1fms, %zu files\n", _milliseconds_since(start), perEntryFiles.size());
+
+	int status = 0;
+	for (bool useEntryTypes : {true, false}) {
+		for (int32 threadCount : {1, 0}) {
+			// a new scanner each time so nothing comes from its index
+			DirectoryScanner scanner(threadCount);
+			scanner.SetUseEntryTypes(useEntryTypes);
+			std::vector<std::string> files;
+			start = std::chrono::steady_clock::now();
+			scanner.Scan({root}, files);
+			double time = _milliseconds_since(start);
+			printf("DirectoryScanner, %d %-8s %-7s %8.1fms, %zu files\n", (int)scanner.CountThreads(),
+				scanner.CountThreads() == 1 ? "thread," : "threads,", useEntryTypes ? "d_type:" : "stat():",
+				time, files.size());
+
+			if (files.size() != perEntryFiles.size()) {
+				fprintf(stderr, "Error: the scanner found a different number of files\n");
+				status = 1;
+			}
+		}
+	}
+
+	std::filesystem::remove_all(root);
+
+	return status;
+}